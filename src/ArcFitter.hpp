@@ -0,0 +1,207 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numbers>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "Toolpath.hpp"
+
+// 圆弧拟合：把连续的、功率相同的 G1 折线中落在同一圆弧容差内的点替换为一条 G2/G3，减少指令数，让控制器的前瞻规划不必在每个顶点减速。
+// Arc fitting: replaces runs of consecutive G1 moves with equal power whose points lie within a tolerance of one circular arc by a single G2/G3, so fewer commands reach the controller and its planner no longer slows down at every vertex.
+// 贪心地从当前点向后延伸，每段圆弧最多 kMaxPoints 个点，因此总耗时与点数成线性关系。直线（所有点都在弦的容差内）保持为 G1。
+// It extends greedily from the current point with at most kMaxPoints points per arc, so the total time is linear in the number of points. Straight runs (every point within the tolerance of the chord) stay G1.
+class ArcFitter
+{
+public:
+    static constexpr int kMinSegments = 3;   // 至少替换的线段数(Fewest segments worth replacing)
+    static constexpr int kMaxPoints   = 64;  // 每段圆弧的最多点数(Most points per arc)
+
+    struct Report {
+        std::size_t before {0};  // 拟合前指令数(Commands before)
+        std::size_t after {0};   // 拟合后指令数(Commands after)
+        std::size_t arcs {0};    // 生成的圆弧数(Arcs produced)
+    };
+
+    // tolerance 为点到圆弧的最大偏差，单位为微米
+    // tolerance is the largest deviation of a point from the arc, in micrometres
+    explicit ArcFitter(double tolerance = 10.0) : tolerance(tolerance) {}
+
+    double getTolerance() const noexcept { return tolerance; }
+
+    // 回到程序开头的状态：G0 X0 Y0，S0(Back to the state at the start of the program: G0 X0 Y0, S0)
+    void reset() noexcept {
+        at    = {0, 0};
+        power = 0;
+    }
+
+    // 拟合 path（未经模态压缩的工具路径）。位置和功率从上一次调用的末尾延续，因此可以逐段处理，圆弧不跨段。
+    // Fit path (a toolpath before modal compression). Position and power continue from the end of the previous call, so it can run piece by piece; arcs never span pieces.
+    Report fit(Toolpath &path) {
+        Report report;
+        report.before = path.size();
+
+        Toolpath out;
+        out.reserve(path.size());
+        points.assign(1, at);
+        commands.clear();
+        for(std::size_t i = 0; i < path.size(); ++i) {
+            auto const c = path[i];
+            Point const to {c.hasX() ? c.x : points.back().x, c.hasY() ? c.y : points.back().y};
+            if(c.motion() == Toolpath::Motion::G1) {
+                // 功率变化处断开(Break where the power changes)
+                if(c.hasS() && c.s != power) {
+                    report.arcs += flush(out);
+                    power = c.s;
+                }
+                commands.push_back(c);
+                points.push_back(to);
+                continue;
+            }
+            report.arcs += flush(out);
+            out.push(c);
+            power         = c.hasS() ? c.s : power;
+            points.back() = to;
+        }
+        report.arcs += flush(out);
+        at = points.back();
+
+        path         = std::move(out);
+        report.after = path.size();
+        return report;
+    }
+
+private:
+    struct Point {
+        std::int32_t x, y;
+    };
+
+    struct Circle {
+        double x, y;  // 圆心，相对起点(Centre, relative to the start point)
+        bool ccw;     // 逆时针(Counterclockwise)
+    };
+
+    // 输出缓存的 G1 串：points[0] 为起点，commands[k] 走到 points[k + 1]。输出后只保留终点。
+    // Emit the buffered G1 run: points[0] is the start and commands[k] goes to points[k + 1]. Only the end point is kept afterwards.
+    std::size_t flush(Toolpath &out) {
+        std::size_t arcs = 0;
+        auto const n     = static_cast<int>(commands.size());
+        for(int i = 0; i < n;) {
+            // 逐点延伸，第一次失败即停止；弦太短或仍是直线时还无法判断，继续延伸
+            // Extend point by point and stop at the first failure; a chord that is too short or still straight cannot be judged yet, so keep extending
+            int best = 0, undecided = i;
+            Circle circle {};
+            for(int k = i + kMinSegments; k <= std::min(n, i + kMaxPoints - 1); ++k) {
+                Circle c {};
+                auto const result = fits(i, k, c);
+                if(result == Fit::No) {
+                    break;
+                }
+                if(result == Fit::Undecided) {
+                    undecided = k;
+                    continue;
+                }
+                best   = k;
+                circle = c;
+            }
+            if(best == 0) {
+                // 直线部分整段跳过，只留下可能成为圆弧起点的最后几段(Skip the straight part as a whole, keeping only the last few segments that may start an arc)
+                for(auto const next = std::max(i + 1, undecided - kMinSegments); i < next; ++i) {
+                    out.push(commands[i]);
+                }
+                continue;
+            }
+
+            auto const &end   = points[best];
+            auto const &first = commands[i];
+            out.pushArc(circle.ccw ? Toolpath::Motion::G3 : Toolpath::Motion::G2, end.x, end.y, static_cast<std::int32_t>(std::lround(circle.x)), static_cast<std::int32_t>(std::lround(circle.y)),
+                        first.hasS() ? std::optional<int>(first.s) : std::nullopt);
+            ++arcs;
+            i = best;
+        }
+        points.assign(1, points.back());
+        commands.clear();
+        return arcs;
+    }
+
+    enum class Fit {
+        No,
+        Undecided,  // 弦太短或所有点都在弦的容差内(The chord is too short or every point is within the tolerance of the chord)
+        Yes,
+    };
+
+    // points[i..k] 是否在同一圆弧的容差内：圆过 points[i]、中点和 points[k]，所有点和每段弦的拱高都在容差内，方向一致且扫过的角度小于 270 度。
+    // Whether points[i..k] lie within the tolerance of one arc: the circle passes through points[i], the middle point and points[k], every point and the sagitta of every chord are within the tolerance, the turn direction never changes and the sweep stays below 270 degrees.
+    Fit fits(int i, int k, Circle &circle) const noexcept {
+        auto const &a  = points[i];
+        auto const rel = [&](int t) {
+            return std::pair {static_cast<double>(points[t].x) - a.x, static_cast<double>(points[t].y) - a.y};
+        };
+        auto const [bx, by] = rel((i + k) / 2);
+        auto const [cx, cy] = rel(k);
+        auto const d        = 2.0 * (bx * cy - by * cx);
+        auto const chord    = std::hypot(cx, cy);
+        if(chord < tolerance) {
+            return Fit::Undecided;
+        }
+
+        // 所有点都在弦的容差内时是直线，留给 G1(Every point within the tolerance of the chord is a straight line and stays G1)
+        bool straight = true;
+        for(int t = i + 1; t < k && straight; ++t) {
+            auto const [px, py] = rel(t);
+            straight            = std::abs(px * cy - py * cx) / chord <= tolerance;
+        }
+        if(straight) {
+            return Fit::Undecided;
+        }
+        if(std::abs(d) < 1e-9) {
+            return Fit::No;
+        }
+
+        auto const b2 = bx * bx + by * by;
+        auto const c2 = cx * cx + cy * cy;
+        circle.x      = (cy * b2 - by * c2) / d;
+        circle.y      = (bx * c2 - cx * b2) / d;
+        circle.ccw    = d > 0;
+        auto const r  = std::hypot(circle.x, circle.y);
+
+        double sweep = 0;
+        for(int t = i; t < k; ++t) {
+            auto const [px, py] = rel(t);
+            auto const [qx, qy] = rel(t + 1);
+            auto const ux       = px - circle.x;
+            auto const uy       = py - circle.y;
+            auto const vx       = qx - circle.x;
+            auto const vy       = qy - circle.y;
+            auto const cross    = ux * vy - uy * vx;
+            if(cross == 0 || (cross > 0) != circle.ccw) {
+                return Fit::No;
+            }
+            if(std::abs(std::hypot(vx, vy) - r) > tolerance) {
+                return Fit::No;
+            }
+            auto const half = std::hypot(qx - px, qy - py) / 2;
+            if(half >= r || r - std::sqrt(r * r - half * half) > tolerance) {
+                return Fit::No;
+            }
+            sweep += std::atan2(std::abs(cross), ux * vx + uy * vy);
+        }
+        if(sweep > 1.5 * std::numbers::pi) {
+            return Fit::No;
+        }
+
+        // 圆心取整到微米后终点仍需在容差内(The end point must still be within the tolerance once the centre is rounded to micrometres)
+        auto const ix = std::round(circle.x);
+        auto const iy = std::round(circle.y);
+        return std::abs(std::hypot(cx - ix, cy - iy) - std::hypot(ix, iy)) <= tolerance ? Fit::Yes : Fit::No;
+    }
+
+private:
+    double tolerance;
+    Point at {0, 0};          // 当前位置(Current position)
+    std::uint16_t power {0};  // 当前功率(Current power)
+    std::vector<Point> points;
+    std::vector<Toolpath::Command> commands;
+};
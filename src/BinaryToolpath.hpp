@@ -0,0 +1,400 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "GCodeSink.hpp"
+#include "MappedFile.hpp"
+#include "ModalCompressor.hpp"
+#include "Toolpath.hpp"
+
+// 紧凑的二进制工具路径格式 (.tpb)，与文本 G 代码一起导出，用于归档、预览和重新发送。所有数值均为小端。
+// Compact binary toolpath format (.tpb), exported alongside the text G-code for archiving, preview and resending. Every number is little-endian.
+//
+// 文件头 80 字节(80-byte file header):
+//   0  "TPB\0"     4  u16 版本(version)      6  u16 标志(flags)，bit0 = 模态压缩(modal compression)
+//   8  u64 指令数(commands)                   16 u64 主体偏移(body offset)    24 u64 主体字节数(body size)
+//   32 u64 索引偏移(index offset)             40 u32 每块指令数(commands per chunk)   44 u32 坐标网格 微米(coordinate grid, micrometre)
+//   48 u8 扫描方式(scan mode)  49 u8 激光模式(laser mode)  50 保留 6 字节(6 reserved bytes)
+//   56 f64 宽度 mm(width)      64 f64 高度 mm(height)      72 f64 精度 lin/mm(resolution)
+// 之后是头部和尾部 G 代码行：u32 行数，每行 u32 长度 + 文本。
+// Then the header and footer G-code lines: u32 line count, each line a u32 length + text.
+//
+// 主体每条指令：操作码 1 字节，之后按操作码标记依次为 X、Y（与上一个 X/Y 的差，以网格为单位）、圆弧的 I、J（微米）、S（与上一个 S 的差），均为 zigzag varint。
+// Body, per command: the opcode byte followed, as flagged by the opcode, by X and Y (delta from the previous X/Y in grid units), I and J of arcs (micrometre) and S (delta from the previous S), all zigzag varints.
+// 网格是所有 X/Y 的最大公约数，光栅扫描时即像素间距。相邻坐标通常只差几个像素，多数指令只需 2-4 字节，而文本约 15-30 字节。
+// The grid is the greatest common divisor of every X/Y, the pixel pitch for raster scans. Neighbouring coordinates are usually a few pixels apart, so most commands take 2-4 bytes against about 15-30 bytes of text.
+//
+// 索引：每 kChunkCommands 条指令一项，记录该块在主体中的偏移以及块开始时的 X、Y、S，可以从任意一块开始解码。
+// Index: one entry per kChunkCommands commands holding the offset of the chunk in the body and X, Y and S at its start, so decoding can start at any chunk.
+//   u64 偏移(offset)  i32 X  i32 Y  u16 S
+class BinaryToolpath
+{
+public:
+    static constexpr char kMagic[4]               = {'T', 'P', 'B', '\0'};
+    static constexpr std::uint16_t kVersion       = 1;
+    static constexpr std::uint16_t kModalFlag     = 0x0001;
+    static constexpr std::uint32_t kChunkCommands = 4096;
+    static constexpr std::size_t kHeaderSize      = 80;
+    static constexpr std::size_t kIndexEntrySize  = 18;
+
+    // 作业参数(Job parameters)
+    struct Job {
+        double width {0};       // 毫米(mm)
+        double height {0};      // 毫米(mm)
+        double resolution {0};  // lin/mm
+        std::uint8_t scanMode {0};
+        std::uint8_t laserMode {0};
+        bool modalCompression {false};    // 转换为文本时经过模态压缩(Modal compression is applied when converting to text)
+        std::vector<std::string> header;  // 头部 G 代码(Header G-code)
+        std::vector<std::string> footer;  // 尾部 G 代码(Footer G-code)
+    };
+
+    static bool write(const std::string &fileName, const Toolpath &path, const Job &job) {
+        std::string out(kHeaderSize, '\0');
+        for(auto const *lines: {&job.header, &job.footer}) {
+            put(out, static_cast<std::uint32_t>(lines->size()));
+            for(auto const &line: *lines) {
+                put(out, static_cast<std::uint32_t>(line.size()));
+                out += line;
+            }
+        }
+
+        std::uint32_t grid = 0;
+        for(std::size_t i = 0; i < path.size(); ++i) {
+            auto const c = path[i];
+            grid         = c.hasX() ? std::gcd(grid, static_cast<std::uint32_t>(std::abs(static_cast<std::int64_t>(c.x)))) : grid;
+            grid         = c.hasY() ? std::gcd(grid, static_cast<std::uint32_t>(std::abs(static_cast<std::int64_t>(c.y)))) : grid;
+        }
+        grid = std::max<std::uint32_t>(grid, 1);
+
+        std::string index;
+        auto const bodyOffset = out.size();
+        std::int32_t x        = 0;
+        std::int32_t y        = 0;
+        std::uint16_t s       = 0;
+        for(std::size_t i = 0; i < path.size(); ++i) {
+            if(i % kChunkCommands == 0) {
+                put(index, static_cast<std::uint64_t>(out.size() - bodyOffset));
+                put(index, x);
+                put(index, y);
+                put(index, s);
+            }
+            auto const c = path[i];
+            out += static_cast<char>(c.op);
+            if(c.hasX()) {
+                putVarint(out, zigzag((static_cast<std::int64_t>(c.x) - x) / grid));
+                x = c.x;
+            }
+            if(c.hasY()) {
+                putVarint(out, zigzag((static_cast<std::int64_t>(c.y) - y) / grid));
+                y = c.y;
+            }
+            if(c.isArc()) {
+                putVarint(out, zigzag(c.i));
+                putVarint(out, zigzag(c.j));
+            }
+            if(c.hasS()) {
+                putVarint(out, zigzag(static_cast<std::int64_t>(c.s) - s));
+                s = c.s;
+            }
+        }
+        auto const bodySize    = out.size() - bodyOffset;
+        auto const indexOffset = out.size();
+        out += index;
+
+        std::string header;
+        header.append(kMagic, sizeof(kMagic));
+        put(header, kVersion);
+        put(header, static_cast<std::uint16_t>(job.modalCompression ? kModalFlag : 0));
+        put(header, static_cast<std::uint64_t>(path.size()));
+        put(header, static_cast<std::uint64_t>(bodyOffset));
+        put(header, static_cast<std::uint64_t>(bodySize));
+        put(header, static_cast<std::uint64_t>(indexOffset));
+        put(header, kChunkCommands);
+        put(header, grid);
+        put(header, job.scanMode);
+        put(header, job.laserMode);
+        header.append(6, '\0');
+        put(header, job.width);
+        put(header, job.height);
+        put(header, job.resolution);
+        out.replace(0, kHeaderSize, header);
+
+        std::ofstream file(fileName, std::ios_base::binary | std::ios_base::trunc);
+        file.write(out.data(), static_cast<std::streamsize>(out.size()));
+        return file.good();
+    }
+
+    static std::uint64_t zigzag(std::int64_t v) noexcept {
+        return (static_cast<std::uint64_t>(v) << 1) ^ static_cast<std::uint64_t>(v >> 63);
+    }
+
+    static std::int64_t unzigzag(std::uint64_t v) noexcept {
+        return static_cast<std::int64_t>(v >> 1) ^ -static_cast<std::int64_t>(v & 1);
+    }
+
+    template<class T>
+    static void put(std::string &out, T value) {
+        using U = std::conditional_t<sizeof(T) == 1, std::uint8_t, std::conditional_t<sizeof(T) == 2, std::uint16_t, std::conditional_t<sizeof(T) == 4, std::uint32_t, std::uint64_t>>>;
+        auto u = std::bit_cast<U>(value);
+        if constexpr(std::endian::native == std::endian::big && sizeof(T) > 1) {
+            u = std::byteswap(u);
+        }
+        char bytes[sizeof(T)];
+        std::memcpy(bytes, &u, sizeof(T));
+        out.append(bytes, sizeof(T));
+    }
+
+    template<class T>
+    static T get(const std::uint8_t *p) noexcept {
+        using U = std::conditional_t<sizeof(T) == 1, std::uint8_t, std::conditional_t<sizeof(T) == 2, std::uint16_t, std::conditional_t<sizeof(T) == 4, std::uint32_t, std::uint64_t>>>;
+        U u;
+        std::memcpy(&u, p, sizeof(T));
+        if constexpr(std::endian::native == std::endian::big && sizeof(T) > 1) {
+            u = std::byteswap(u);
+        }
+        return std::bit_cast<T>(u);
+    }
+
+    static void putVarint(std::string &out, std::uint64_t v) {
+        while(v >= 0x80) {
+            out += static_cast<char>(v | 0x80);
+            v >>= 7;
+        }
+        out += static_cast<char>(v);
+    }
+
+    // 读一个 varint，越界或超过 10 字节时返回 false(Read one varint, false when it runs past end or beyond 10 bytes)
+    static bool getVarint(const std::uint8_t *&p, const std::uint8_t *end, std::uint64_t &v) noexcept {
+        v = 0;
+        for(int shift = 0; p < end && shift < 64; shift += 7) {
+            auto const b = *p++;
+            v |= static_cast<std::uint64_t>(b & 0x7F) << shift;
+            if(!(b & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// .tpb 读取器：内存映射文件，直接在映射上解码，不复制主体。可以逐条遍历、从任意指令开始遍历、读入 Toolpath 或直接转换为文本 G 代码。
+// .tpb reader: memory-maps the file and decodes straight from the mapping without copying the body. It can iterate every command, iterate from any command, load a Toolpath or convert to text G-code on the fly.
+// 转换的文本与 ImageToGCode::exportGCode() 对同一工具路径的输出逐字节相同。
+// The converted text is byte-identical to what ImageToGCode::exportGCode() writes for the same toolpath.
+class BinaryToolpathReader
+{
+public:
+    BinaryToolpathReader() = default;
+
+    explicit BinaryToolpathReader(const std::string &fileName) { open(fileName); }
+
+    // 打开并校验文件头、头尾行和索引，失败时返回 false(Open and validate the file header, header/footer lines and index, false on failure)
+    bool open(const std::string &fileName) {
+        close();
+        if(!file.open(fileName) || file.size() < BinaryToolpath::kHeaderSize || std::memcmp(file.data(), BinaryToolpath::kMagic, sizeof(BinaryToolpath::kMagic)) != 0) {
+            close();
+            return false;
+        }
+        auto const *p = file.data();
+        using B       = BinaryToolpath;
+        if(B::get<std::uint16_t>(p + 4) != B::kVersion) {
+            close();
+            return false;
+        }
+        job.modalCompression = B::get<std::uint16_t>(p + 6) & B::kModalFlag;
+        commands             = B::get<std::uint64_t>(p + 8);
+        bodyOffset           = B::get<std::uint64_t>(p + 16);
+        bodySize             = B::get<std::uint64_t>(p + 24);
+        indexOffset          = B::get<std::uint64_t>(p + 32);
+        chunk                = B::get<std::uint32_t>(p + 40);
+        grid                 = B::get<std::uint32_t>(p + 44);
+        job.scanMode         = B::get<std::uint8_t>(p + 48);
+        job.laserMode        = B::get<std::uint8_t>(p + 49);
+        job.width            = B::get<double>(p + 56);
+        job.height           = B::get<double>(p + 64);
+        job.resolution       = B::get<double>(p + 72);
+
+        auto const chunks = chunk == 0 ? 0 : (commands + chunk - 1) / chunk;
+        if(chunk == 0 || grid == 0 || bodyOffset > file.size() || bodySize > file.size() - bodyOffset || indexOffset != bodyOffset + bodySize
+           || chunks > (file.size() - indexOffset) / B::kIndexEntrySize || !readLines()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() noexcept {
+        file.close();
+        job      = {};
+        commands = 0;
+    }
+
+    bool isOpen() const noexcept { return file.isOpen(); }
+
+    const BinaryToolpath::Job &getJob() const noexcept { return job; }
+
+    // 指令数(Number of commands)
+    std::size_t size() const noexcept { return static_cast<std::size_t>(commands); }
+
+    // 依次解码第 [first, first + count) 条指令并调用 f(const Toolpath::Command &)，从 first 所在的块开始解码。文件损坏时返回 false。
+    // Decode commands [first, first + count) in order and call f(const Toolpath::Command &), decoding starts at the chunk holding first. Returns false on a corrupt file.
+    template<class F>
+    bool forEach(F &&f, std::size_t first = 0, std::size_t count = std::numeric_limits<std::size_t>::max()) const {
+        using B         = BinaryToolpath;
+        auto const last = first + std::min(count, size() - std::min(first, size()));
+        if(first >= last) {
+            return true;
+        }
+        auto const *entry = file.data() + indexOffset + (first / chunk) * B::kIndexEntrySize;
+        auto const *body  = file.data() + bodyOffset;
+        auto const *end   = body + bodySize;
+        auto const *p     = body + B::get<std::uint64_t>(entry);
+        auto x            = B::get<std::int32_t>(entry + 8);
+        auto y            = B::get<std::int32_t>(entry + 12);
+        std::int64_t s    = B::get<std::uint16_t>(entry + 16);
+        if(p > end) {
+            return false;
+        }
+
+        for(auto i = first / chunk * chunk; i < last; ++i) {
+            if(p >= end) {
+                return false;
+            }
+            Toolpath::Command c {*p++, 0, 0, 0};
+            std::uint64_t v = 0;
+            if(c.hasX()) {
+                if(!B::getVarint(p, end, v)) {
+                    return false;
+                }
+                c.x = x = step(x, v);
+            }
+            if(c.hasY()) {
+                if(!B::getVarint(p, end, v)) {
+                    return false;
+                }
+                c.y = y = step(y, v);
+            }
+            if(c.isArc()) {
+                std::uint64_t j = 0;
+                if(!B::getVarint(p, end, v) || !B::getVarint(p, end, j)) {
+                    return false;
+                }
+                c.i = static_cast<std::int32_t>(B::unzigzag(v));
+                c.j = static_cast<std::int32_t>(B::unzigzag(j));
+            }
+            if(c.hasS()) {
+                if(!B::getVarint(p, end, v)) {
+                    return false;
+                }
+                c.s = static_cast<std::uint16_t>(s += B::unzigzag(v));
+            }
+            if(i >= first) {
+                f(c);
+            }
+        }
+        return true;
+    }
+
+    // 读入 [first, first + count) 条指令，追加到 out(Load commands [first, first + count) and append them to out)
+    bool read(Toolpath &out, std::size_t first = 0, std::size_t count = std::numeric_limits<std::size_t>::max()) const {
+        out.reserve(out.size() + std::min(count, size()));
+        return forEach([&](const Toolpath::Command &c) { out.push(c); }, first, count);
+    }
+
+    // 转换为文本 G 代码：头部、主体（按需模态压缩）、尾部。按块解码，内存占用与文件大小无关。
+    // Convert to text G-code: header, body (modal-compressed when flagged) and footer. Decodes chunk by chunk, so memory does not depend on the file size.
+    bool writeText(GCodeSink &out) const {
+        for(auto const &line: job.header) {
+            out.write(line);
+        }
+        ModalCompressor compressor;
+        compressor.reset(Toolpath::Motion::G0, 0, 0, 0);
+        Toolpath buffer;
+        Toolpath compressed;
+        for(std::size_t first = 0; first < size(); first += chunk) {
+            buffer.clear();
+            if(!read(buffer, first, chunk)) {
+                return false;
+            }
+            if(job.modalCompression) {
+                compressed.clear();
+                compressor.compress(buffer, compressed);
+                out.write(compressed);
+            } else {
+                out.write(buffer);
+            }
+        }
+        if(job.modalCompression) {
+            compressed.clear();
+            compressor.finish(compressed);
+            out.write(compressed);
+        }
+        for(auto const &line: job.footer) {
+            out.write(line);
+        }
+        return out.flush();
+    }
+
+    bool exportGCode(const std::string &fileName) const {
+        std::fstream text;
+        text.open(fileName, std::ios_base::out | std::ios_base::trunc);
+        if(!text.is_open()) {
+            return false;
+        }
+        GCodeSink sink(text);
+        return writeText(sink);
+    }
+
+private:
+    bool readLines() {
+        auto const *p   = file.data() + BinaryToolpath::kHeaderSize;
+        auto const *end = file.data() + bodyOffset;
+        for(auto *lines: {&job.header, &job.footer}) {
+            if(end - p < 4) {
+                return false;
+            }
+            auto const n = BinaryToolpath::get<std::uint32_t>(p);
+            p += 4;
+            for(std::uint32_t k = 0; k < n; ++k) {
+                if(end - p < 4) {
+                    return false;
+                }
+                auto const length = BinaryToolpath::get<std::uint32_t>(p);
+                p += 4;
+                if(static_cast<std::uint64_t>(end - p) < length) {
+                    return false;
+                }
+                lines->emplace_back(reinterpret_cast<const char *>(p), length);
+                p += length;
+            }
+        }
+        return true;
+    }
+
+    // 把以网格为单位的差加到坐标上，按 32 位回绕，损坏的文件也不会溢出
+    // Add a delta in grid units to a coordinate, wrapping at 32 bits so a corrupt file can not overflow
+    std::int32_t step(std::int32_t from, std::uint64_t v) const noexcept {
+        return static_cast<std::int32_t>(static_cast<std::uint32_t>(from) + static_cast<std::uint32_t>(BinaryToolpath::unzigzag(v)) * grid);
+    }
+
+private:
+    MappedFile file;
+    BinaryToolpath::Job job;
+    std::uint64_t commands {0};
+    std::uint64_t bodyOffset {0};
+    std::uint64_t bodySize {0};
+    std::uint64_t indexOffset {0};
+    std::uint32_t chunk {BinaryToolpath::kChunkCommands};
+    std::uint32_t grid {1};
+};
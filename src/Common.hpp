@@ -1,4 +1,6 @@
 #pragma once
+#include <charconv>
+#include <cstdint>
 #include <fstream>
 #include <optional>
 #include <ranges>
@@ -19,68 +21,127 @@ inline bool ExportGCode(const std::string &fileName, std::vector<std::string> &&
     return true;
 }
 
-struct G0 {
-    std::optional<float> x, y;
-    std::optional<int> s;
+// G 代码编码器：直接写入调用者提供的字符缓冲区，不分配内存。
+// G-code encoder writing straight into a caller-supplied char buffer without allocating.
+struct GCodeEncoder {
+    // 一行指令的最大长度（G2/G3 的四个最大 float 坐标加功率）
+    // Maximum length of one line (the four maximal float coordinates of G2/G3 plus power)
+    static constexpr std::size_t kMaxLine = 256;
+
+    static char *writeInt(char *out, int v) noexcept {
+        return std::to_chars(out, out + 16, v).ptr;
+    }
+
+    // 按 {:.3f} 写出 float。std::format 的 {:.3f} 本身就是以 std::to_chars 定义的，因此输出逐字节相同。
+    // Write a float as {:.3f}. std::format's {:.3f} is specified in terms of std::to_chars, so the bytes are identical.
+    static char *writeFixed3(char *out, float v) noexcept {
+        return std::to_chars(out, out + 64, v, std::chars_format::fixed, 3).ptr;
+    }
+
+    // 定点微米整数按 {:.3f} 写出，只做整数运算。与 float 的 {:.3f} 只有一处不同：(-0.0005, 0) 内的值取整为 0 微米，写出 0.000 而不是 -0.000。
+    // Write a fixed-point micrometre integer as {:.3f} using integer arithmetic only. The one difference from {:.3f} of the float: values in (-0.0005, 0) round to 0 micrometres and print 0.000 instead of -0.000.
+    static char *writeMicro(char *out, std::int32_t micro) noexcept {
+        auto a = static_cast<std::uint32_t>(micro);
+        if (micro < 0) {
+            *out++ = '-';
+            a      = 0u - a;
+        }
+        out          = std::to_chars(out, out + 16, a / 1000).ptr;
+        auto const r = a % 1000;
+        out[0]       = '.';
+        out[1]       = static_cast<char>('0' + r / 100);
+        out[2]       = static_cast<char>('0' + r / 10 % 10);
+        out[3]       = static_cast<char>('0' + r % 10);
+        return out + 4;
+    }
+
+    static char *writeWord(char *out, char word) noexcept {
+        out[0] = ' ';
+        out[1] = word;
+        return out + 2;
+    }
 
-    std::string toString() {
-        std::string command = "G0";
+    static char *writeMotion(char *out, int motion) noexcept {
+        out[0] = 'G';
+        return writeInt(out + 1, motion);
+    }
+
+    static char *encode(char *out, int motion, const std::optional<float> &x, const std::optional<float> &y, const std::optional<int> &s) noexcept {
+        out = writeMotion(out, motion);
         if (x.has_value()) {
-            command += std::format(" X{:.3f}", x.value());
+            out = writeFixed3(writeWord(out, 'X'), x.value());
         }
         if (y.has_value()) {
-            command += std::format(" Y{:.3f}", y.value());
+            out = writeFixed3(writeWord(out, 'Y'), y.value());
         }
         if (s.has_value()) {
-            command += std::format(" S{:d}", s.value());
+            out = writeInt(writeWord(out, 'S'), s.value());
         }
-        return command;
+        return out;
     }
 
-    explicit operator std::string() const {
-        std::string command = "G0";
+    static char *encodeArc(char *out, int motion, const std::optional<float> &x, const std::optional<float> &y, float i, float j, const std::optional<int> &s) noexcept {
+        out = writeMotion(out, motion);
         if (x.has_value()) {
-            command += std::format(" X{:.3f}", x.value());
+            out = writeFixed3(writeWord(out, 'X'), x.value());
         }
         if (y.has_value()) {
-            command += std::format(" Y{:.3f}", y.value());
+            out = writeFixed3(writeWord(out, 'Y'), y.value());
         }
+        out = writeFixed3(writeWord(out, 'I'), i);
+        out = writeFixed3(writeWord(out, 'J'), j);
         if (s.has_value()) {
-            command += std::format(" S{:d}", s.value());
+            out = writeInt(writeWord(out, 'S'), s.value());
         }
-        return command;
+        return out;
     }
 };
 
-struct G1 {
+// G0 快速移动、G1 直线插补，两者只有指令编号不同
+// G0 rapid move and G1 linear move, they only differ by the command number
+template<int Motion>
+struct GMove {
     std::optional<float> x, y;
     std::optional<int> s;
 
-    std::string toString() {
-        std::string command = "G1";
-        if (x.has_value()) {
-            command += std::format(" X{:.3f}", x.value());
-        }
-        if (y.has_value()) {
-            command += std::format(" Y{:.3f}", y.value());
-        }
-        if (s.has_value()) {
-            command += std::format(" S{:d}", s.value());
-        }
-        return command;
+    char *encode(char *out) const noexcept {
+        return GCodeEncoder::encode(out, Motion, x, y, s);
+    }
+
+    std::string toString() const {
+        char buffer[GCodeEncoder::kMaxLine];
+        return {buffer, encode(buffer)};
     }
 
     explicit operator std::string() const {
-        std::string command = "G1";
-        if (x.has_value()) {
-            command += std::format(" X{:.3f}", x.value());
-        }
-        if (y.has_value()) {
-            command += std::format(" Y{:.3f}", y.value());
-        }
-        if (s.has_value()) {
-            command += std::format(" S{:d}", s.value());
-        }
-        return command;
+        return toString();
+    }
+};
+
+using G0 = GMove<0>;
+using G1 = GMove<1>;
+
+// G2 顺时针圆弧、G3 逆时针圆弧，I/J 为圆心相对起点的偏移
+// G2 clockwise arc and G3 counterclockwise arc, I/J is the offset of the centre from the start point
+template<int Motion>
+struct GArc {
+    std::optional<float> x, y;
+    float i {0}, j {0};
+    std::optional<int> s;
+
+    char *encode(char *out) const noexcept {
+        return GCodeEncoder::encodeArc(out, Motion, x, y, i, j, s);
+    }
+
+    std::string toString() const {
+        char buffer[GCodeEncoder::kMaxLine];
+        return {buffer, encode(buffer)};
+    }
+
+    explicit operator std::string() const {
+        return toString();
     }
 };
+
+using G2 = GArc<2>;
+using G3 = GArc<3>;
@@ -0,0 +1,203 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #include <emmintrin.h>
+#endif
+
+// 半色调预处理：把缩放后的灰度栅格就地转换为只有 0 和 255 的二值图像，保留照片的明暗层次。
+// Halftone preprocessing: converts the resized gray raster in place into a binary image of 0 and 255, keeping the tone of photos.
+// 可以逐条带调用 apply()，误差在条带之间延续，结果与整幅处理逐字节相同。
+// apply() can be called strip by strip, the error carries over between strips and the result is byte-identical to processing the whole image.
+class Dither
+{
+public:
+    enum class Method {
+        None,
+        FloydSteinberg,  // 误差扩散 2 行(Error diffusion over 2 rows)
+        Jarvis,          // Jarvis-Judice-Ninke，误差扩散 3 行(Error diffusion over 3 rows)
+        Stucki,          // 误差扩散 3 行(Error diffusion over 3 rows)
+        Atkinson,        // 只扩散 3/4 的误差，对比度更高(Diffuses only 3/4 of the error, higher contrast)
+        Bayer,           // 8x8 有序抖动(8x8 ordered dither)
+    };
+
+    void setMethod(Method value) noexcept { method = value; }
+
+    Method getMethod() const noexcept { return method; }
+
+    // 误差扩散的线程数，按行流水线并行，每行比上一行落后两个分块
+    // Threads for error diffusion, pipelined by rows with every row trailing the previous one by two chunks
+    void setThreadCount(int count) noexcept { threads = std::max(1, count); }
+
+    // 开始新的一幅图像(Start a new image)
+    void reset() noexcept {
+        row = 0;
+        errors.clear();
+    }
+
+    // 处理接下来的 rows 行，data 指向第一行，行间距为 step 字节
+    // Process the next rows rows, data points to the first row and rows are step bytes apart
+    void apply(std::uint8_t *data, std::size_t step, int rows, int cols) {
+        if(method == Method::None || rows <= 0 || cols <= 0) {
+            return;
+        }
+        if(method == Method::Bayer) {
+            for(int r = 0; r < rows; ++r) {
+                bayerRow(data + r * step, cols, row + r);
+            }
+        } else {
+            diffuse(data, step, rows, cols);
+        }
+        row += rows;
+    }
+
+private:
+    struct Tap {
+        int dx;
+        int dy;
+        int weight;
+    };
+
+    struct Kernel {
+        std::array<Tap, 12> taps;
+        int count;
+        int divisor;
+    };
+
+    static constexpr int kRadius = 2;   // 核的最大水平半径(Maximum horizontal radius of the kernels)
+    static constexpr int kChunk  = 64;  // 流水线同步的分块宽度(Chunk width of the pipeline synchronization)
+
+    static constexpr Kernel kernel(Method method) noexcept {
+        switch(method) {
+            case Method::Jarvis:
+                return {{{{1, 0, 7}, {2, 0, 5}, {-2, 1, 3}, {-1, 1, 5}, {0, 1, 7}, {1, 1, 5}, {2, 1, 3}, {-2, 2, 1}, {-1, 2, 3}, {0, 2, 5}, {1, 2, 3}, {2, 2, 1}}}, 12, 48};
+            case Method::Stucki:
+                return {{{{1, 0, 8}, {2, 0, 4}, {-2, 1, 2}, {-1, 1, 4}, {0, 1, 8}, {1, 1, 4}, {2, 1, 2}, {-2, 2, 1}, {-1, 2, 2}, {0, 2, 4}, {1, 2, 2}, {2, 2, 1}}}, 12, 42};
+            case Method::Atkinson:
+                return {{{{1, 0, 1}, {2, 0, 1}, {-1, 1, 1}, {0, 1, 1}, {1, 1, 1}, {0, 2, 1}}}, 6, 8};
+            default:
+                return {{{{1, 0, 7}, {-1, 1, 3}, {0, 1, 5}, {1, 1, 1}}}, 4, 16};
+        }
+    }
+
+    // 误差扩散。误差按 行号 % slots 存放在环形缓冲中，每行左右各留 kRadius 的余量；累计的是 误差*权重，读出时再除以 divisor。
+    // Error diffusion. Errors live in a ring buffer indexed by row % slots with kRadius of margin on both sides; it accumulates error * weight and divides by the divisor on read.
+    // 第 r 行处理分块 c 前等待第 r-1 行完成分块 c+1，此时第 r 行需要的误差已全部到齐，且两行写入的位置不会重叠。
+    // Row r waits for row r-1 to finish chunk c+1 before processing chunk c, by then all error row r needs has arrived and the two rows never write the same entries.
+    // 同一时刻最多有 threads 行在处理，每行写到下面两行，slots = threads + 4 足以保证复用的行已经完成并清零。
+    // At most threads rows are in flight and each writes up to two rows ahead, so slots = threads + 4 guarantees a reused row is finished and cleared.
+    void diffuse(std::uint8_t *data, std::size_t step, int rows, int cols) {
+        auto const width = cols + 2 * kRadius;
+        if(errors.empty()) {
+            slots = threads + 4;
+            errors.assign(static_cast<std::size_t>(slots) * width, 0);
+        }
+        auto const workers = std::min({threads, rows, slots - 4});
+
+        auto const k      = kernel(method);
+        auto const chunks = (cols + kChunk - 1) / kChunk;
+        std::vector<std::atomic<int>> progress(rows);
+
+        auto const work = [&](int first) {
+            for(int r = first; r < rows; r += workers) {
+                auto const y = row + r;
+                auto *pixels = data + r * step;
+                auto *error  = slot(y, width);
+                for(int c = 0; c < chunks; ++c) {
+                    if(r > 0) {
+                        auto const need = std::min(chunks, c + 2);
+                        while(progress[r - 1].load(std::memory_order_acquire) < need) {
+                            std::this_thread::yield();
+                        }
+                    }
+                    for(int x = c * kChunk, end = std::min(cols, x + kChunk); x < end; ++x) {
+                        auto const value = pixels[x] + error[x + kRadius] / k.divisor;
+                        auto const out   = value < 128 ? 0 : 255;
+                        auto const e     = value - out;
+                        pixels[x]        = static_cast<std::uint8_t>(out);
+                        for(int t = 0; t < k.count; ++t) {
+                            auto const &tap = k.taps[t];
+                            slot(y + tap.dy, width)[x + tap.dx + kRadius] += e * tap.weight;
+                        }
+                    }
+                    if(c + 1 < chunks) {
+                        progress[r].store(c + 1, std::memory_order_release);
+                    }
+                }
+                std::fill(error, error + width, 0);
+                progress[r].store(chunks, std::memory_order_release);
+            }
+        };
+
+        if(workers == 1) {
+            work(0);
+            return;
+        }
+        std::vector<std::thread> pool;
+        pool.reserve(workers - 1);
+        for(int t = 1; t < workers; ++t) {
+            pool.emplace_back(work, t);
+        }
+        work(0);
+        for(auto &t: pool) {
+            t.join();
+        }
+    }
+
+    std::int32_t *slot(int y, int width) noexcept {
+        return errors.data() + static_cast<std::size_t>(y % slots) * width;
+    }
+
+    // 8x8 Bayer 阈值，(index + 0.5) * 4，范围 [2, 254]
+    // 8x8 Bayer thresholds, (index + 0.5) * 4 in [2, 254]
+    static constexpr std::array<std::array<std::uint8_t, 8>, 8> kBayer = [] {
+        std::array<std::array<std::uint8_t, 8>, 8> m {};
+        for(int y = 0; y < 8; ++y) {
+            for(int x = 0; x < 8; ++x) {
+                // 交错 x^y 与 y 的位得到 Bayer 下标(Interleave the bits of x^y and y to get the Bayer index)
+                int const a = x ^ y;
+                int index   = 0;
+                for(int bit = 0; bit < 3; ++bit) {
+                    index |= ((a >> bit) & 1) << (5 - 2 * bit);
+                    index |= ((y >> bit) & 1) << (4 - 2 * bit);
+                }
+                m[y][x] = static_cast<std::uint8_t>(index * 4 + 2);
+            }
+        }
+        return m;
+    }();
+
+    // 有序抖动：像素 >= 阈值为 255，否则为 0。x86 上每次比较 16 个像素。
+    // Ordered dither: 255 where pixel >= threshold, 0 otherwise. Compares 16 pixels at a time on x86.
+    static void bayerRow(std::uint8_t *pixels, int cols, int y) noexcept {
+        auto const &threshold = kBayer[y & 7];
+        int x                 = 0;
+#if defined(__x86_64__) || defined(_M_X64)
+        std::uint8_t pattern[16];
+        for(int i = 0; i < 16; ++i) {
+            pattern[i] = threshold[i & 7];
+        }
+        auto const t = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pattern));
+        for(; x + 16 <= cols; x += 16) {
+            auto const p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + x));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(pixels + x), _mm_cmpeq_epi8(_mm_max_epu8(p, t), p));
+        }
+#endif
+        for(; x < cols; ++x) {
+            pixels[x] = pixels[x] >= threshold[x & 7] ? 255 : 0;
+        }
+    }
+
+private:
+    Method method {Method::None};
+    int threads {1};
+    int row {0};    // 下一行的行号(Index of the next row)
+    int slots {0};  // 误差环形缓冲的行数(Rows of the error ring buffer)
+    std::vector<std::int32_t> errors;
+};
@@ -0,0 +1,200 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "GCodeSink.hpp"
+#include "MappedFile.hpp"
+
+// 按内容寻址的 G 代码缓存：键是输入像素（或图像文件内容）与全部生成参数的哈希，每个程序一个文件 <键>.nc。
+// Content-addressed G-code cache: the key is a hash of the input pixels (or image file contents) and every generation parameter, one file <key>.nc per program.
+// 命中时直接把缓存的程序写到输出，不再解码、缩放和扫描。总大小超过容量时按最后使用时间（文件修改时间）淘汰最久未用的程序。
+// A hit writes the cached program straight to the output without decoding, resizing or scanning. Once the total size exceeds the capacity the least recently used programs (by file modification time) are evicted.
+// 可以被多个线程共享；写入先落到临时文件再改名，多个进程共用同一目录也不会读到写了一半的程序。
+// It can be shared by several threads; stores go to a temporary file that is then renamed, so processes sharing the directory never see a half-written program.
+// 进程在改名前退出会留下临时文件，超过 kStaleAge 的临时文件在打开缓存和淘汰时删除。
+// A process dying before the rename leaves its temporary file behind; temporary files older than kStaleAge are removed when the cache is opened and on eviction.
+class GCodeCache
+{
+public:
+    // 临时文件超过这个时间仍未改名即视为遗留(A temporary file not renamed within this time is considered orphaned)
+    static constexpr std::chrono::hours kStaleAge {1};
+
+    struct Statistics {
+        std::uint64_t hits {0};       // 命中次数(Hits)
+        std::uint64_t misses {0};     // 未命中次数(Misses)
+        std::uint64_t stores {0};     // 写入的程序数(Programs stored)
+        std::uint64_t evictions {0};  // 淘汰的程序数(Programs evicted)
+        std::uintmax_t bytes {0};     // 缓存当前大小(Current size of the cache)
+    };
+
+    // capacity 为缓存目录的最大字节数，目录不存在时创建
+    // capacity is the largest size of the cache directory in bytes, the directory is created when missing
+    explicit GCodeCache(std::filesystem::path directory, std::uintmax_t capacity = std::uintmax_t {1} << 30) : directory(std::move(directory)), capacity(capacity) {
+        std::error_code ec;
+        std::filesystem::create_directories(this->directory, ec);
+        removeStale();
+        for(auto const &entry: std::filesystem::directory_iterator(this->directory, ec)) {
+            if(isEntry(entry)) {
+                bytes += entry.file_size(ec);
+            }
+        }
+    }
+
+    GCodeCache(const GCodeCache &) = delete;
+
+    GCodeCache &operator=(const GCodeCache &) = delete;
+
+    // 查询 key 并计入命中/未命中；命中时刷新其使用时间
+    // Look up key and count a hit or miss; a hit refreshes its use time
+    bool lookup(std::uint64_t key) {
+        std::error_code ec;
+        std::filesystem::last_write_time(path(key), std::filesystem::file_time_type::clock::now(), ec);
+        ++(ec ? misses : hits);
+        return !ec;
+    }
+
+    // 把缓存的程序写到 out。在 lookup() 之后被其他进程淘汰时返回 false 且不写入任何内容；写出失败时也返回 false，此时 out 中可能已有部分程序，out.good() 为 false。
+    // Write the cached program to out. Returns false without writing anything when another process evicted it after lookup(); also returns false when writing fails, out may then hold part of the program and out.good() is false.
+    bool fetch(std::uint64_t key, GCodeSink &out) const {
+        MappedFile file;
+        if(!file.open(path(key).string())) {
+            return false;
+        }
+        out.writeBytes({reinterpret_cast<const char *>(file.data()), file.size()});
+        return out.good();
+    }
+
+    // 把已经写好的程序文件存入缓存，之后按需淘汰
+    // Store an already written program file in the cache, then evict as needed
+    bool store(std::uint64_t key, const std::filesystem::path &program) {
+        auto const target = path(key);
+        auto const unique = std::hash<std::thread::id> {}(std::this_thread::get_id()) ^ static_cast<std::size_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+        auto const temp   = directory / std::format("{:016x}.{:x}.tmp", key, unique);
+        std::error_code ec;
+        std::filesystem::copy_file(program, temp, std::filesystem::copy_options::overwrite_existing, ec);
+        auto const size = ec ? 0 : std::filesystem::file_size(temp, ec);
+        if(ec) {
+            std::filesystem::remove(temp, ec);
+            return false;
+        }
+
+        // 被替换文件的大小、改名和计数在锁内完成，同一个键的并发写入不会重复计数(The replaced size, the rename and the accounting happen under the lock, so concurrent stores of one key are not counted twice)
+        std::lock_guard lock(mutex);
+        auto const replaced = std::filesystem::file_size(target, ec);
+        auto const existed  = !ec;
+        std::filesystem::rename(temp, target, ec);
+        if(ec) {
+            std::filesystem::remove(temp, ec);
+            return false;
+        }
+
+        ++stores;
+        if((bytes += size - (existed ? replaced : 0)) > capacity) {
+            evict();
+        }
+        return true;
+    }
+
+    // 删除所有缓存的程序(Remove every cached program)
+    void clear() {
+        std::lock_guard lock(mutex);
+        std::error_code ec;
+        for(auto const &entry: std::filesystem::directory_iterator(directory, ec)) {
+            if(isEntry(entry)) {
+                std::filesystem::remove(entry.path(), ec);
+            }
+        }
+        bytes = 0;
+    }
+
+    Statistics getStatistics() const noexcept {
+        return {hits.load(), misses.load(), stores.load(), evictions.load(), bytes.load()};
+    }
+
+    const std::filesystem::path &getDirectory() const noexcept { return directory; }
+
+private:
+    std::filesystem::path path(std::uint64_t key) const {
+        return directory / std::format("{:016x}.nc", key);
+    }
+
+    static bool isEntry(const std::filesystem::directory_entry &entry) {
+        auto const name = entry.path().filename().string();
+        return entry.is_regular_file() && name.size() == 19 && name.ends_with(".nc");
+    }
+
+    // store() 的临时文件 <键>.<序号>.tmp(A temporary file of store(), <key>.<unique>.tmp)
+    static bool isTemporary(const std::filesystem::directory_entry &entry) {
+        auto const name = entry.path().filename().string();
+        return entry.is_regular_file() && name.size() > 21 && name[16] == '.' && name.ends_with(".tmp");
+    }
+
+    // 删除遗留的临时文件，正在写入的临时文件修改时间很近，不受影响
+    // Remove orphaned temporary files, a temporary file being written has a recent modification time and is left alone
+    void removeStale() {
+        std::error_code ec;
+        auto const limit = std::filesystem::file_time_type::clock::now() - kStaleAge;
+        for(auto const &entry: std::filesystem::directory_iterator(directory, ec)) {
+            if(isTemporary(entry) && entry.last_write_time(ec) < limit && !ec) {
+                std::filesystem::remove(entry.path(), ec);
+            }
+        }
+    }
+
+    // 删除遗留的临时文件，重新统计目录（其他进程可能也在写入），从最久未用的开始删除，直到不超过容量的 90%，避免每次写入都触发淘汰
+    // Remove orphaned temporary files, recount the directory (other processes may write to it too) and delete from the least recently used until it is within 90% of the capacity, so not every store triggers an eviction
+    // 调用时持有 mutex(Called with mutex held)
+    void evict() {
+        removeStale();
+        struct Entry {
+            std::filesystem::file_time_type time;
+            std::uintmax_t size;
+            std::filesystem::path path;
+        };
+        std::vector<Entry> entries;
+        std::uintmax_t total = 0;
+        std::error_code ec;
+        for(auto const &entry: std::filesystem::directory_iterator(directory, ec)) {
+            if(isEntry(entry)) {
+                auto const size = entry.file_size(ec);
+                entries.push_back({entry.last_write_time(ec), size, entry.path()});
+                total += size;
+            }
+        }
+
+        auto const limit = capacity / 10 * 9;
+        if(total > limit) {
+            std::ranges::sort(entries, {}, &Entry::time);
+            for(auto const &e: entries) {
+                if(total <= limit) {
+                    break;
+                }
+                if(std::filesystem::remove(e.path, ec)) {
+                    total -= e.size;
+                    ++evictions;
+                }
+            }
+        }
+        bytes = total;
+    }
+
+private:
+    std::filesystem::path directory;
+    std::uintmax_t capacity;
+    std::mutex mutex;  // 串行化改名、大小统计和淘汰(Serializes renames, size accounting and eviction)
+    std::atomic<std::uint64_t> hits {0};
+    std::atomic<std::uint64_t> misses {0};
+    std::atomic<std::uint64_t> stores {0};
+    std::atomic<std::uint64_t> evictions {0};
+    std::atomic<std::uintmax_t> bytes {0};
+};
@@ -0,0 +1,114 @@
+#pragma once
+#include <algorithm>
+#include <cstring>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+#if defined(_WIN32)
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
+
+#include "Toolpath.hpp"
+
+// 带缓冲的 G 代码输出端，目标可以是 std::ostream 或文件描述符。
+// Buffered G-code sink writing to either a std::ostream or a file descriptor.
+// 缓冲区写满即落盘，因此生成过程中就能看到输出，内存占用与程序长度无关。
+// The buffer is flushed whenever it fills up, so output reaches disk while generation is still running and memory does not grow with the program length.
+class GCodeSink
+{
+public:
+    static constexpr std::size_t kBufferSize = 64 * 1024;
+    static constexpr std::size_t kMaxLine    = GCodeEncoder::kMaxLine;  // 单条指令的最大长度，与编码器一致(Maximum length of one formatted command, the same as the encoder)
+
+    explicit GCodeSink(std::ostream &os) : os(&os), buffer(kBufferSize) {}
+
+    explicit GCodeSink(int fd) : fd(fd), buffer(kBufferSize) {}
+
+    GCodeSink(const GCodeSink &) = delete;
+
+    GCodeSink &operator=(const GCodeSink &) = delete;
+
+    ~GCodeSink() { flush(); }
+
+    // 写入一行文本并追加换行
+    // Write one line of text followed by a newline
+    void write(std::string_view line) {
+        if(buffer.size() - used < line.size() + 1) {
+            flush();
+            if(buffer.size() < line.size() + 1) {
+                buffer.resize(line.size() + 1);
+            }
+        }
+        std::memcpy(buffer.data() + used, line.data(), line.size());
+        used += line.size();
+        buffer[used++] = '\n';
+    }
+
+    // 把工具路径格式化后写入，不产生临时字符串
+    // Format and write a toolpath without creating temporary strings
+    void write(const Toolpath &path) {
+        for(std::size_t i = 0; i < path.size(); ++i) {
+            if(buffer.size() - used < kMaxLine) {
+                flush();
+            }
+            char *end = path.encode(buffer.data() + used, i);
+            *end++    = '\n';
+            used      = static_cast<std::size_t>(end - buffer.data());
+        }
+    }
+
+    // 原样写入已经格式化好的 G 代码，例如缓存的程序；超过缓冲区的部分直接写出，不经过复制
+    // Write already formatted G-code as is, e.g. a cached program; whatever exceeds the buffer is written directly without copying
+    void writeBytes(std::string_view bytes) {
+        if(buffer.size() - used >= bytes.size()) {
+            std::memcpy(buffer.data() + used, bytes.data(), bytes.size());
+            used += bytes.size();
+            return;
+        }
+        flush();
+        put(bytes.data(), bytes.size());
+    }
+
+    bool flush() {
+        if(used == 0) {
+            return ok;
+        }
+        put(buffer.data(), used);
+        used = 0;
+        return ok;
+    }
+
+    bool good() const noexcept { return ok; }
+
+private:
+    void put(const char *data, std::size_t size) {
+        if(os != nullptr) {
+            os->write(data, static_cast<std::streamsize>(size));
+            ok = ok && os->good();
+            return;
+        }
+        std::size_t written = 0;
+        while(ok && written < size) {
+#if defined(_WIN32)
+            auto n = ::_write(fd, data + written, static_cast<unsigned int>(std::min<std::size_t>(size - written, 1u << 30)));
+#else
+            auto n = ::write(fd, data + written, size - written);
+#endif
+            if(n <= 0) {
+                ok = false;
+                break;
+            }
+            written += static_cast<std::size_t>(n);
+        }
+    }
+
+private:
+    std::ostream *os {nullptr};
+    int fd {-1};
+    std::vector<char> buffer;
+    std::size_t used {0};
+    bool ok {true};
+};
@@ -0,0 +1,130 @@
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// 64 位 XXH64 哈希，可分多次 update()，结果与一次性计算相同。用于缓存键和逐行比较，不用于安全场景。
+// 64-bit XXH64 hash. update() can be called repeatedly and gives the same result as hashing in one go. Used for cache keys and row comparison, not for security.
+class Hash64
+{
+public:
+    explicit Hash64(std::uint64_t seed = 0) noexcept { reset(seed); }
+
+    void reset(std::uint64_t seed = 0) noexcept {
+        lanes[0] = seed + kPrime1 + kPrime2;
+        lanes[1] = seed + kPrime2;
+        lanes[2] = seed;
+        lanes[3] = seed - kPrime1;
+        this->seed = seed;
+        total      = 0;
+        pending    = 0;
+    }
+
+    Hash64 &update(const void *data, std::size_t size) noexcept {
+        auto const *p   = static_cast<const std::uint8_t *>(data);
+        auto const *end = p + size;
+        total += size;
+
+        if(pending + size < sizeof(buffer)) {
+            std::memcpy(buffer + pending, p, size);
+            pending += size;
+            return *this;
+        }
+        if(pending > 0) {
+            auto const fill = sizeof(buffer) - pending;
+            std::memcpy(buffer + pending, p, fill);
+            stripe(buffer);
+            p += fill;
+            pending = 0;
+        }
+        for(; end - p >= static_cast<std::ptrdiff_t>(sizeof(buffer)); p += sizeof(buffer)) {
+            stripe(p);
+        }
+        pending = static_cast<std::size_t>(end - p);
+        std::memcpy(buffer, p, pending);
+        return *this;
+    }
+
+    // 按对象表示哈希数值、枚举等平凡类型(Hash numbers, enums and other trivial types by their object representation)
+    template<class T>
+        requires std::is_trivially_copyable_v<T>
+    Hash64 &update(const T &value) noexcept {
+        return update(&value, sizeof(value));
+    }
+
+    std::uint64_t digest() const noexcept {
+        std::uint64_t h = 0;
+        if(total >= sizeof(buffer)) {
+            h = std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) + std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18);
+            for(auto const lane: lanes) {
+                h = (h ^ round(0, lane)) * kPrime1 + kPrime4;
+            }
+        } else {
+            h = seed + kPrime5;
+        }
+        h += total;
+
+        auto const *p   = buffer;
+        auto const *end = buffer + pending;
+        for(; p + 8 <= end; p += 8) {
+            h = std::rotl(h ^ round(0, read64(p)), 27) * kPrime1 + kPrime4;
+        }
+        if(p + 4 <= end) {
+            h = std::rotl(h ^ read32(p) * kPrime1, 23) * kPrime2 + kPrime3;
+            p += 4;
+        }
+        for(; p < end; ++p) {
+            h = std::rotl(h ^ *p * kPrime5, 11) * kPrime1;
+        }
+
+        h ^= h >> 33;
+        h *= kPrime2;
+        h ^= h >> 29;
+        h *= kPrime3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    static std::uint64_t of(const void *data, std::size_t size, std::uint64_t seed = 0) noexcept {
+        return Hash64(seed).update(data, size).digest();
+    }
+
+private:
+    static constexpr std::uint64_t kPrime1 = 11400714785074694791ULL;
+    static constexpr std::uint64_t kPrime2 = 14029467366897019727ULL;
+    static constexpr std::uint64_t kPrime3 = 1609587929392839161ULL;
+    static constexpr std::uint64_t kPrime4 = 9650029242287828579ULL;
+    static constexpr std::uint64_t kPrime5 = 2870177450012600261ULL;
+
+    static std::uint64_t round(std::uint64_t acc, std::uint64_t input) noexcept {
+        return std::rotl(acc + input * kPrime2, 31) * kPrime1;
+    }
+
+    // 按小端读取，保证不同平台上的哈希值相同(Read little-endian so the hash is the same on every platform)
+    static std::uint64_t read64(const std::uint8_t *p) noexcept {
+        std::uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return std::endian::native == std::endian::little ? v : std::byteswap(v);
+    }
+
+    static std::uint64_t read32(const std::uint8_t *p) noexcept {
+        std::uint32_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return std::endian::native == std::endian::little ? v : std::byteswap(v);
+    }
+
+    void stripe(const std::uint8_t *p) noexcept {
+        for(int i = 0; i < 4; ++i) {
+            lanes[i] = round(lanes[i], read64(p + 8 * i));
+        }
+    }
+
+private:
+    std::uint64_t lanes[4];
+    std::uint64_t seed;
+    std::uint64_t total;
+    std::uint8_t buffer[32];
+    std::size_t pending;
+};
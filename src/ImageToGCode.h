@@ -3,8 +3,35 @@
 #include <fstream>
 #include <print>
 #include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <charconv>
+#include <exception>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <numbers>
+#include <numeric>
+#include <thread>
 
+#include "ArcFitter.hpp"
+#include "BinaryToolpath.hpp"
 #include "Common.hpp"
+#include "Toolpath.hpp"
+#include "Dither.hpp"
+#include "GCodeCache.hpp"
+#include "GCodeSink.hpp"
+#include "Hash.hpp"
+#include "Instrumentation.hpp"
+#include "MappedFile.hpp"
+#include "ModalCompressor.hpp"
+#include "NearestNeighbour.hpp"
+#include "PowerCurve.hpp"
+#include "Resampler.hpp"
+#include "RunExtractor.hpp"
+#include "TravelOptimizer.hpp"
+#include "WorkStealingPool.hpp"
 
 class ImageToGCode
 {
@@ -23,6 +50,10 @@ public:
         Spiral,        // 螺旋
         Block,         // 分块 根据像素的灰度级别进行扫描，例如255像素分8个级别，那么0-32就是一个级别，32-64就是另外一个级别，以此类推。
         // (Block scanning is performed based on the gray level of the pixels. For example, 255 pixels are divided into 8 levels, then 0-32 is one level, 32-64 is another level, and so on.)
+        BidirectionStd,  // 双向 标准库实现，逐像素 G1，只合并连续空白(Bidirectional, standard library implementation, one G1 per pixel and only blanks are merged)
+        DiagonalUnidirection,  // 单斜向，所有斜线同一方向(Single diagonal, every diagonal runs the same way)
+        Hatch,                 // 任意角度的双向填充线，角度由 setHatchAngle 设置(Bidirectional hatch lines at any angle set by setHatchAngle)
+        Contour,               // 矢量轮廓，沿二值化图像的边界输出闭合折线，容差由 setContourTolerance 设置(Vector contours, closed polylines along the edges of the binarized image with the tolerance set by setContourTolerance)
     };
 
     struct kEnumToStringLaserMode {
@@ -51,9 +82,57 @@ public:
 
     auto &setInputImage(const cv::Mat &mat) {
         this->mat = mat;
+        mapped.close();
+        resetInputFile();
         return *this;
     }
 
+    // 从文件读取输入。8 位二进制 PGM (P5) 直接内存映射，按条带读取，不把整幅图像载入内存；其他格式由 OpenCV 整体解码。
+    // Read the input from a file. 8-bit binary PGM (P5) is memory-mapped and read strip by strip without loading the whole image; other formats are decoded as a whole by OpenCV.
+    // 其他格式推迟到生成时解码，缓存命中则不解码；文件内容在缓存或增量生成第一次需要时才做哈希，因此与 setCache() 的先后顺序无关
+    // Other formats are decoded at generation and never on a cache hit; the file contents are hashed when the cache or incremental generation first needs them, so the order relative to setCache() does not matter
+    auto &setInputFile(const std::string &fileName) {
+        mat.release();
+        resetInputFile();
+        if(mapped.open(fileName) && parsePgm()) {
+            return *this;
+        }
+        if(mapped.isOpen()) {
+            pendingFile = fileName;
+            mapped.close();
+            return *this;
+        }
+        mapped.close();
+        mat = cv::imread(fileName, cv::IMREAD_GRAYSCALE);
+        if(mat.empty()) {
+            std::println("can not read {}", fileName);
+        }
+        return *this;
+    }
+
+    // 无文件头的 8 位灰度原始数据，offset 为像素数据在文件中的起始位置
+    // Headerless 8-bit grayscale raw data, offset is where the pixel data starts in the file
+    auto &setInputRaw(const std::string &fileName, int cols, int rows, std::size_t offset = 0) {
+        mat.release();
+        resetInputFile();
+        if(!mapped.open(fileName) || cols <= 0 || rows <= 0 || mapped.size() < offset + static_cast<std::size_t>(cols) * rows) {
+            std::println("can not read {}", fileName);
+            mapped.close();
+            return *this;
+        }
+        mappedCols   = cols;
+        mappedRows   = rows;
+        mappedOffset = offset;
+        return *this;
+    }
+
+    // 是否有可用的输入图像；推迟解码的文件在生成时才能确定(Whether there is a usable input image; a file with deferred decoding is only known at generation)
+    bool hasInput() const noexcept {
+        return !pendingFile.empty() || (sourceCols() > 0 && sourceRows() > 0 && (mapped.isOpen() || mat.type() == CV_8UC1));
+    }
+
+    // 输出尺寸（毫米）与精度。缩放为面积平均（AreaResampler），与早期版本使用的 cv::resize 双线性插值结果不同：缩小时每个输出像素取它覆盖的所有源像素的平均，细线不会丢失
+    // Output size (mm) and resolution. Resampling is area averaging (AreaResampler) and differs from the cv::resize bilinear interpolation of earlier versions: when shrinking, every output pixel is the mean of all the source pixels it covers, so thin lines are not lost
     auto &setOutputTragetSize(double width, double height, double resolution = 10.0 /* lin/mm */) {
         this->width      = width;
         this->height     = height;
@@ -62,31 +141,23 @@ public:
     }
 
     auto &builder() {
-        command.clear();
-        try {
-            matToGCode();
-        } catch(cv::Exception &e) {
-            std::println("cv Exception {}", e.what());
+        if(metrics.isEnabled()) {
+            metrics.reset();
         }
-
-        std::vector<std::string> header;
-        header.emplace_back("G17G21G90G54");                                             // XY平面;单位毫米;绝对坐标模式;选择G54坐标系(XY plane; unit mm; absolute coordinate mode; select G54 coordinate system)
-        header.emplace_back(std::format("F{:d}", 30000));                                // 移动速度 毫米/每分钟(Moving speed mm/min)
-        header.emplace_back(std::format("G0 X{:.3f} Y{:.3f}", 0.f, 0.f));                // 设置工作起点及偏移(Set the starting point and offset of the work)
-        header.emplace_back(std::format("{} S0", kEnumToStringLaserMode()[laserMode]));  // 激光模式(laser mode)
-        if(airPump.has_value()) {
-            header.emplace_back(std::format("M16 S{:d}", 300));  // 打开气泵(Turn on the air pump)
+        // 输入只哈希一次，摘要和逐行哈希同时供缓存与增量生成使用(The input is hashed once, the digest and row hashes serve both the cache and incremental generation)
+        auto const input = inputDigest(incremental.enabled);
+        if(lookupCache(input)) {
+            command.clear();
+            incremental.valid = false;
+            return *this;
         }
-
-        std::vector<std::string> footer;
-        footer.emplace_back("M5");
-        if(airPump.has_value()) {
-            footer.emplace_back("M9");  // 关闭气泵，保持 S300 功率(Turn off air pump and maintain S300 power)
+        if(incremental.enabled && input && reuseBody(*input)) {
+            metrics.count(command);
+            header = makeHeader();
+            footer = makeFooter();
+            return *this;
         }
-
-        command.insert_range(command.begin(), header);
-        command.append_range(footer);
-
+        build();
         return *this;
     }
 
@@ -98,37 +169,865 @@ public:
             return false;
         }
 
-        for(auto &&v: command | std::views::transform([](auto item) { return item += "\n"; })) {
-            file.write(v.c_str(), v.length());
+        auto const scope = metrics.scope("export");
+        {
+            GCodeSink sink(file);
+            if(cacheHit) {
+                // builder() 之后改了模态压缩时按新的键重新查询(Look up the new key when modal compression changed after builder())
+                if(auto const key = makeCacheKey(); key == *cacheKey || cache->lookup(key)) {
+                    cacheKey = key;
+                    if(cache->fetch(key, sink)) {
+                        return sink.flush();
+                    }
+                    // 写出失败时输出中可能已有部分缓存的程序，不能在其后重新生成(A failed write may have left part of the cached program in the output, nothing can be generated after it)
+                    if(!sink.good()) {
+                        return false;
+                    }
+                }
+                // 命中之后被其他进程淘汰，重新生成(Evicted by another process after the hit, generate it again)
+                cacheHit = false;
+                build();
+                cacheInput = makeCacheInput(hashInput());
+            }
+            for(auto &&v: header) {
+                sink.write(v);
+            }
+            beginBody();
+            writeBody(sink, command);
+            finishBody(sink);
+            for(auto &&v: footer) {
+                sink.write(v);
+            }
+            if(!sink.flush()) {
+                return false;
+            }
         }
+        file.close();
+        storeCache(fileName);
+        return true;
+    }
 
+    // 导出紧凑的二进制工具路径 (.tpb)，包含作业参数和头尾 G 代码，可由 BinaryToolpathReader 读取或转换回相同的文本
+    // Export the compact binary toolpath (.tpb) with the job parameters and header/footer G-code, readable by BinaryToolpathReader or convertible back to the same text
+    bool exportBinary(const std::string &fileName) {
+        if(cacheHit) {
+            // 缓存命中时没有工具路径，重新生成(A cache hit holds no toolpath, generate it)
+            cacheHit = false;
+            build();
+        }
+        auto const scope = metrics.scope("export");
+        BinaryToolpath::Job job;
+        job.width            = width;
+        job.height           = height;
+        job.resolution       = resolution;
+        job.scanMode         = static_cast<std::uint8_t>(scanMode);
+        job.laserMode        = static_cast<std::uint8_t>(laserMode);
+        job.modalCompression = modalCompression;
+        job.header           = header;
+        job.footer           = footer;
+        if(!BinaryToolpath::write(fileName, command, job)) {
+            std::println("can not export binary toolpath");
+            return false;
+        }
         return true;
     }
 
-    auto setLaserMode(LaserMode mode) {
+    // 流式生成：每扫描完一行就写入输出，不保留整个程序，内存占用只与行宽相关。
+    // Streaming generation: each scanline is written as soon as it is done, the whole program is never held and memory only depends on the row width.
+    bool streamGCode(const std::string &fileName) {
+        std::fstream file;
+        file.open(fileName, std::ios_base::out | std::ios_base::trunc);
+        if(!file.is_open()) {
+            std::println("can not export gcode");
+            return false;
+        }
+        if(!streamGCode(file)) {
+            return false;
+        }
+        file.close();
+        storeCache(fileName);
+        return true;
+    }
+
+
+    bool streamGCode(std::ostream &os) {
+        GCodeSink sink(os);
+        return streamGCode(sink);
+    }
+
+    // fd 为已打开的文件描述符，调用者负责关闭
+    // fd is an already opened file descriptor, the caller is responsible for closing it
+    bool streamGCode(int fd) {
+        GCodeSink sink(fd);
+        return streamGCode(sink);
+    }
+
+    // 计时与统计：按阶段计时 (hash、resize、dither、strategy、band、arcs、encode、export、stream)，并统计 G0/G1/圆弧数量、空移与出光距离、功率变化次数。
+    // Instrumentation: per-phase timers (hash, resize, dither, strategy, band, arcs, encode, export, stream) and counters for G0/G1/arc commands, rapid and burn distance and power changes.
+    // 在 builder() 或 streamGCode() 之后查询，关闭时几乎没有开销
+    // Query it after builder() or streamGCode(), it costs almost nothing when disabled
+    auto &setInstrumentation(bool enable) {
+        metrics.enable(enable);
+        return *this;
+    }
+
+    const Instrumentation &getInstrumentation() const noexcept {
+        return metrics;
+    }
+
+    // 空移优化：重新排列出光链的顺序和方向以缩短 G0 距离，budget 为时间预算。需要完整的工具路径，流式生成时不进行。
+    // Travel optimization: reorders and reverses burn chains to shorten G0 travel within the time budget. It needs the whole toolpath and is skipped when streaming.
+    // 结果取决于机器负载，相同参数不一定得到相同的程序，因此打开时不使用结果缓存
+    // The result depends on machine load and equal parameters need not give the same program, so the result cache is not used while it is on
+    auto &setTravelOptimization(bool enable, std::chrono::milliseconds budget = std::chrono::milliseconds(1000)) {
+        travelOptimization = enable;
+        travelBudget       = budget;
+        return *this;
+    }
+
+    // 圆弧拟合：把落在同一圆弧容差内的 G1 折线替换为 G2/G3，tolerance 单位为毫米。流式生成时按行拟合，圆弧不跨行。
+    // Arc fitting: replaces G1 polylines that lie within the tolerance of a circular arc by G2/G3, tolerance is in millimetres. When streaming it fits row by row and arcs never span rows.
+    auto &setArcFitting(bool enable, double tolerance = 0.01) {
+        arcFitter.reset();
+        if(enable) {
+            arcFitter.emplace(tolerance * 1000.0);
+        }
+        return *this;
+    }
+
+    // 最近一次 builder() 的空移优化结果，包括优化前后的空移距离
+    // Result of the travel optimization of the last builder(), including the rapid distance before and after
+    const TravelOptimizer::Report &getTravelReport() const noexcept {
+        return travelReport;
+    }
+
+    // 生成的工具路径中间表示，可用于后处理
+    // The generated toolpath intermediate representation, usable by post-processing passes
+    const Toolpath &getToolpath() const noexcept {
+        return command;
+    }
+
+    auto &setLaserMode(LaserMode mode) {
         laserMode = mode;
         return *this;
     }
 
-    auto setScanMode(ScanMode mode) {
+    auto &setScanMode(ScanMode mode) {
         scanMode = mode;
         return *this;
     }
 
+    // 模态压缩：只输出变化的字段，并合并共线同功率的移动，减少串口传输量和行数
+    // Modal compression: only emit words that change and merge collinear moves with equal power, reducing serial bytes and line count
+    auto &setModalCompression(bool enable) {
+        modalCompression = enable;
+        return *this;
+    }
+
+    // 生成 G 代码的线程数，1 为单线程，0 表示使用全部硬件线程
+    // Number of threads generating G-code, 1 is serial and 0 uses every hardware thread
+    auto &setThreadCount(int count) {
+        threadCount = count > 0 ? count : static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        return *this;
+    }
+
+    // 分块扫描的灰度级别数，0-254 均分为 levels 个级别，每个级别单独雕刻一遍
+    // Number of gray levels for block scanning, 0-254 is split evenly into levels and each level is engraved as its own pass
+    auto &setBlockLevels(int levels) {
+        blockLevels = std::clamp(levels, 1, 255);
+        return *this;
+    }
+
+    // 灰度到功率的传递曲线，例如 PowerCurve::gamma(2.2, 255).clamp(20, 255)；默认为线性，最大功率 S=1000
+    // Gray to power transfer curve, e.g. PowerCurve::gamma(2.2, 255).clamp(20, 255); linear with maximum power S=1000 by default
+    auto &setPowerCurve(const PowerCurve &curve) {
+        powerCurve = curve;
+        return *this;
+    }
+
+    // 预处理：垂直翻转，与缩放在同一遍内完成，替代 cv::flip
+    // Preprocessing: vertical flip, fused with resampling instead of a separate cv::flip
+    auto &setFlipVertical(bool flip) {
+        flipVertical = flip;
+        return *this;
+    }
+
+    // 预处理：灰度查找表，缩放时逐像素应用，可用于阈值、反相、亮度和对比度
+    // Preprocessing: gray lookup table applied per pixel while resampling, for threshold, inversion, brightness and contrast
+    auto &setToneMap(const std::array<std::uint8_t, 256> &lut) {
+        toneMap = lut;
+        return *this;
+    }
+
+    // 预处理：二值化，灰度 > threshold 为 255，否则为 0，与 cv::threshold (THRESH_BINARY) 相同；负数取消查找表
+    // Preprocessing: binarize, gray > threshold becomes 255 and everything else 0, same as cv::threshold (THRESH_BINARY); a negative value removes the lookup table
+    auto &setThreshold(int threshold) {
+        if(threshold < 0) {
+            toneMap.reset();
+            return *this;
+        }
+        std::array<std::uint8_t, 256> lut {};
+        for(int g = 0; g < 256; ++g) {
+            lut[g] = g > threshold ? 255 : 0;
+        }
+        return setToneMap(lut);
+    }
+
+    // 半色调预处理：缩放后就地抖动为二值图像，保留照片的明暗层次，替代固定阈值二值化
+    // Halftone preprocessing: dithers the resized raster in place into a binary image, keeping the tone of photos instead of a fixed threshold
+    auto &setDither(Dither::Method method) {
+        dither.setMethod(method);
+        return *this;
+    }
+
+    // 轮廓简化容差，单位为毫米，折线与原始边界的最大偏差
+    // Contour simplification tolerance in millimetres, the largest deviation of the polyline from the original edge
+    auto &setContourTolerance(double mm) {
+        contourTolerance = std::max(0.0, mm);
+        return *this;
+    }
+
+    // 填充线角度，单位为度，0 为水平，逆时针（图像坐标中 Y 向下，即朝向 +Y）为正
+    // Hatch angle in degrees, 0 is horizontal and positive turns towards +Y (downwards in image coordinates)
+    auto &setHatchAngle(double degrees) {
+        hatchAngle = degrees;
+        return *this;
+    }
+
+    // 螺旋扫描方向：false 为从外到里，true 为从里到外
+    // Spiral direction: false runs outside-in, true runs inside-out
+    auto &setSpiralInsideOut(bool insideOut) {
+        spiralInsideOut = insideOut;
+        return *this;
+    }
+
+    // 条带高度：逐行扫描方式每次只缩放并处理这么多行输出，峰值内存与条带高度相关而与图像大小无关
+    // Strip height: row-wise scan modes resize and process this many output rows at a time, so peak memory depends on the strip height and not on the image size
+    auto &setStripRows(int rows) {
+        stripRows = std::max(1, rows);
+        return *this;
+    }
+
+    // 结果缓存：builder() 和 streamGCode() 先按输入与参数的哈希查找，命中时直接输出缓存的程序；缓存可以被多个实例共享，为空时关闭。
+    // Result cache: builder() and streamGCode() first look up the hash of the input and parameters, and a hit writes the cached program directly; the cache can be shared by several instances, null disables it.
+    auto &setCache(GCodeCache *cache) {
+        this->cache = cache;
+        return *this;
+    }
+
+    // 最近一次生成是否直接使用了缓存的程序(Whether the last generation used the cached program)
+    bool isCacheHit() const noexcept {
+        return cacheHit;
+    }
+
+    // 增量生成：builder() 记住上次的输入和参数。只改了头尾（速度、激光模式、气泵）时直接复用上次的主体；
+    // Incremental generation: builder() remembers the previous input and parameters. When only the header and footer (feed rate, laser mode, air pump) changed, the previous body is reused as is;
+    // 单向和双向扫描且没有空移优化和圆弧拟合时，改了像素只重新生成预处理后内容变化的行，其余行从上次的主体中复制。
+    // for one-way and bidirectional scanning without travel optimization and arc fitting, a pixel edit only regenerates the rows whose preprocessed contents changed and copies the others from the previous body.
+    auto &setIncrementalBuild(bool enable) {
+        incremental.enabled = enable;
+        incremental.valid   = false;
+        return *this;
+    }
+
+    // 头部：移动速度 F，单位毫米/分钟(Header: feed rate F in mm/min)
+    auto &setFeedRate(int rate) {
+        feedRate = std::max(1, rate);
+        return *this;
+    }
+
+    // 头部和尾部：气泵 M16 S 与 M9，power 范围 [0,1000]，为空时不输出(Header and footer: air pump M16 S and M9, power in [0,1000], nothing is written when empty)
+    auto &setAirPump(std::optional<int> power) {
+        airPump = power.transform([](int p) { return std::clamp(p, 0, 1000); });
+        return *this;
+    }
+
+    // 游程灰度容差：与段首像素灰度差不超过该值的像素合并为同一个 G1，0 表示只合并灰度完全相同的像素
+    // Run gray tolerance: pixels within this gray distance of the first pixel of a run share one G1, 0 only merges identical gray levels
+    auto &setRunTolerance(int tolerance) {
+        runTolerance = std::clamp(tolerance, 0, 254);
+        return *this;
+    }
+
 private:
+    bool streamGCode(GCodeSink &out) {
+        if(metrics.isEnabled()) {
+            metrics.reset();
+        }
+        auto const scope = metrics.scope("stream");
+        incremental.valid = false;
+        if(lookupCache(inputDigest(false))) {
+            if(cache->fetch(*cacheKey, out)) {
+                return out.flush();
+            }
+            if(!out.good()) {
+                return false;
+            }
+        }
+        cacheHit = false;
+        header = makeHeader();
+        footer = makeFooter();
+        for(auto &&v: header) {
+            out.write(v);
+        }
+
+        command.clear();
+        beginBody();
+        if(arcFitter) {
+            arcFitter->reset();
+        }
+        sink = &out;
+        try {
+            auto const scope = metrics.scope("strategy");
+            matToGCode();
+        } catch(cv::Exception &e) {
+            std::println("cv Exception {}", e.what());
+        }
+        endRow();
+        sink = nullptr;
+        finishBody(out);
+
+        for(auto &&v: footer) {
+            out.write(v);
+        }
+        return out.flush();
+    }
+
+    // 完整生成：解码、预处理、扫描和后处理(Full generation: decode, preprocessing, scanning and post-processing)
+    // 由 reuseBody() 开始的增量生成在这里建立行索引，按需从上次的主体拼接未变的行
+    // An incremental generation started by reuseBody() builds the row index here and splices unchanged rows from the previous body when possible
+    void build() {
+        command.clear();
+        auto &state    = incremental;
+        state.indexing = state.tracking && (scanMode == ScanMode::Unidirection || scanMode == ScanMode::Bidirection) && !travelOptimization && !arcFitter;
+        if(state.indexing) {
+            state.nextHashes.assign(static_cast<std::size_t>(targetRows()), 0);
+            state.sizes.assign(static_cast<std::size_t>(targetRows()), 0);
+        }
+        bool failed = false;
+        try {
+            auto const scope = metrics.scope("strategy");
+            matToGCode();
+        } catch(cv::Exception &e) {
+            std::println("cv Exception {}", e.what());
+            failed = true;
+        }
+        if(travelOptimization) {
+            auto const scope = metrics.scope("travel");
+            travelReport     = TravelOptimizer(travelBudget).optimize(command);
+        }
+        if(arcFitter) {
+            auto const scope = metrics.scope("arcs");
+            arcFitter->reset();
+            arcFitter->fit(command);
+        }
+        metrics.count(command);
+
+        // 失败时主体不完整，既不能被下次复用或拼接，也不能存入缓存(A failed generation leaves an incomplete body that must be neither reused, spliced nor cached)
+        if(failed) {
+            cacheInput.reset();
+        }
+        state.valid = state.tracking && hasInput() && !failed;
+        state.rowOffsets.clear();
+        if(state.valid && state.indexing) {
+            state.rowHashes.swap(state.nextHashes);
+            state.rowOffsets.resize(state.sizes.size() + 1, 0);
+            std::partial_sum(state.sizes.begin(), state.sizes.end(), state.rowOffsets.begin() + 1);
+        }
+        state.tracking = false;
+        state.indexing = false;
+        state.splice   = false;
+
+        header = makeHeader();
+        footer = makeFooter();
+    }
+
+    // 增量生成的准备：输入和主体参数都与上次相同时返回 true，沿用现有主体；
+    // Prepare an incremental generation: true when the input and the body parameters equal the previous ones, so the current body stays;
+    // 否则只有输入变了且上次有行索引时，把上次的主体留作拼接来源，由 build() 逐行比较
+    // otherwise, if only the input changed and the previous generation has a row index, keep the previous body as the splice source for build() to compare row by row
+    bool reuseBody(std::uint64_t input) {
+        auto &state       = incremental;
+        auto const body   = hashBody();
+        bool const same   = state.valid && state.body == body;
+        if(same && state.input == input) {
+            return true;
+        }
+        state.splice = same && state.rowOffsets.size() == static_cast<std::size_t>(targetRows()) + 1;
+        if(state.splice) {
+            std::swap(state.previous, command);
+            command.reserve(state.previous.size());
+        }
+
+        // 没有抖动时每个输出行只取决于附近的几个源行，源行都没变的条带可以整带复制而不必预处理（误差扩散会把变化带到下面所有行）
+        // Without dithering every output row only depends on a few nearby source rows, so a strip whose source rows are all unchanged is copied as a whole without preprocessing (error diffusion carries a change into every row below)
+        state.dirtySource.clear();
+        if(state.splice && dither.getMethod() == Dither::Method::None && !state.nextSourceHashes.empty() && state.sourceHashes.size() == state.nextSourceHashes.size()) {
+            state.dirtySource.resize(state.sourceHashes.size() + 1, 0);
+            for(std::size_t y = 0; y < state.sourceHashes.size(); ++y) {
+                state.dirtySource[y + 1] = state.dirtySource[y] + (state.sourceHashes[y] != state.nextSourceHashes[y]);
+            }
+        }
+        state.sourceHashes.swap(state.nextSourceHashes);
+        state.valid    = false;
+        state.tracking = true;
+        state.input    = input;
+        state.body     = body;
+        return false;
+    }
+
+    // 增量生成时，条带 [y0, y1) 用到的源行都没变则不预处理，直接复制上次这些行的指令，返回 true
+    // During incremental generation, if no source row used by strip [y0, y1) changed, copy the previous commands of these rows without preprocessing and return true
+    bool spliceBand(std::vector<AreaResampler> &resamplers, int y0, int y1) {
+        auto &state = incremental;
+        if(!state.indexing || !state.splice || state.dirtySource.empty()) {
+            return false;
+        }
+        if(resamplers.empty()) {
+            resamplers.emplace_back(sourceCols(), sourceRows(), targetCols(), targetRows());
+        }
+        auto [s0, s1] = resamplers.front().sourceRows(y0, y1);
+        if(flipVertical) {
+            std::tie(s0, s1) = std::pair {sourceRows() - s1, sourceRows() - s0};
+        }
+        if(state.dirtySource[s1] != state.dirtySource[s0]) {
+            return false;
+        }
+
+        command.append(state.previous, state.rowOffsets[y0], state.rowOffsets[y1]);
+        for(int y = y0; y < y1; ++y) {
+            state.nextHashes[y] = state.rowHashes[y];
+            state.sizes[y]      = state.rowOffsets[y + 1] - state.rowOffsets[y];
+        }
+        endRow();
+        return true;
+    }
+
+    // 逐行扫描方式的一行：增量生成时记录预处理后的行哈希和指令数，哈希与上次相同的行直接复制上次的指令，否则调用 emit() 生成
+    // One row of a row-wise scan mode: an incremental generation records the hash of the preprocessed row and its command count, and a row whose hash equals the previous one copies the previous commands instead of calling emit()
+    template<class Emit>
+    void spliceRow(const std::uint8_t *row, int cols, int y, Toolpath &out, Emit &&emit) {
+        auto &state = incremental;
+        if(!state.indexing) {
+            emit();
+            return;
+        }
+        auto const begin = out.size();
+        auto const hash  = Hash64::of(row, static_cast<std::size_t>(cols));
+        if(state.splice && hash == state.rowHashes[y]) {
+            out.append(state.previous, state.rowOffsets[y], state.rowOffsets[y + 1]);
+        } else {
+            emit();
+        }
+        state.nextHashes[y] = hash;
+        state.sizes[y]      = out.size() - begin;
+    }
+
+    // 缓存版本，生成结果的格式或算法改变时递增，使旧的缓存全部失效。2：内存输入的缩放改为面积平均
+    // Cache version, bump it whenever the generated output changes format or algorithm so every old entry is invalidated. 2: in-memory inputs are resampled by area averaging
+    static constexpr std::uint64_t kCacheVersion = 2;
+
+    // 空移优化按时间预算停止，输出不可复现，既不查询也不存入(Travel optimization stops on a time budget and its output is not reproducible, so it is neither looked up nor stored)
+    bool usesCache() const noexcept {
+        return cache != nullptr && !travelOptimization;
+    }
+
+    // 缓存或增量生成需要时对输入哈希一次，否则为空
+    // Hash the input once when the cache or incremental generation needs it, empty otherwise
+    std::optional<std::uint64_t> inputDigest(bool incrementalBuild) {
+        if(!hasInput() || !(usesCache() || incrementalBuild)) {
+            return std::nullopt;
+        }
+        return hashInput();
+    }
+
+    // 用输入的摘要计算缓存键并查询缓存，同时建立头尾；没有缓存或输入时返回 false
+    // Compute the cache key from the input digest and look it up, setting up the header and footer as well; false without a cache or an input
+    bool lookupCache(const std::optional<std::uint64_t> &input) {
+        cacheInput.reset();
+        cacheKey.reset();
+        cacheHit = false;
+        if(!input || !usesCache()) {
+            return false;
+        }
+        cacheInput = makeCacheInput(*input);
+        header     = makeHeader();
+        footer     = makeFooter();
+        cacheKey   = makeCacheKey();
+        cacheHit   = cache->lookup(*cacheKey);
+        return cacheHit;
+    }
+
+    // 把刚生成的程序文件存入缓存，键按写出时实际使用的头尾和模态压缩计算
+    // Store the program file just generated in the cache, keyed by the header, footer and modal compression actually used to write it
+    void storeCache(const std::string &fileName) {
+        if(cache != nullptr && cacheInput && !cacheHit) {
+            cache->store(makeCacheKey(), fileName);
+        }
+    }
+
+    // 主体的来源：输入图像与所有影响工具路径的参数，在生成主体时计算。线程数和条带高度只影响速度，不参与。
+    // Source of the body: the input image and every parameter that affects the toolpath, computed when the body is generated. Thread count and strip height only affect speed and are left out.
+    std::uint64_t makeCacheInput(std::uint64_t input) const {
+        return Hash64(kCacheVersion).update(input).update(hashBody()).digest();
+    }
+
+    // 缓存键：主体来源、当前的头尾与模态压缩。头尾和模态压缩在写出时才用到，因此每次写出和存入时重新计算。
+    // Cache key: the body source, the current header and footer and modal compression. Those only apply when writing, so the key is recomputed on every write and store.
+    std::uint64_t makeCacheKey() const {
+        Hash64 hash(*cacheInput);
+        for(auto const *lines: {&header, &footer}) {
+            hash.update(lines->size());
+            for(auto const &line: *lines) {
+                hash.update(line.size()).update(line.data(), line.size());
+            }
+        }
+        return hash.update(modalCompression).digest();
+    }
+
+    // 输入图像的哈希：推迟解码的文件为文件内容，其余为像素
+    // Hash of the input image: the file contents for a file with deferred decoding, the pixels otherwise
+    // 像素输入逐行哈希，每行的哈希留在 incremental.nextSourceHashes 中，供增量生成找出变化的源行
+    // Pixel inputs are hashed row by row and the row hashes are left in incremental.nextSourceHashes for incremental generation to find the changed source rows
+    std::uint64_t hashInput() {
+        auto const scope = metrics.scope("hash");
+        auto &rowHashes  = incremental.nextSourceHashes;
+        rowHashes.clear();
+        Hash64 hash;
+        if(!pendingFile.empty() && !inputFileHash) {
+            // 打不开时按空文件计，之后解码同样失败，不会生成也不会存入(Counted as empty when it cannot be opened, decoding fails later as well so nothing is generated or stored)
+            MappedFile file;
+            inputFileHash = file.open(pendingFile) ? Hash64::of(file.data(), file.size()) : Hash64().digest();
+        }
+        if(inputFileHash) {
+            return hash.update('F').update(*inputFileHash).digest();
+        }
+        auto const cols = sourceCols();
+        auto const rows = sourceRows();
+        rowHashes.resize(static_cast<std::size_t>(std::max(0, rows)));
+        for(int y = 0; y < rows; ++y) {
+            rowHashes[y] = Hash64::of(sourceRow(y), static_cast<std::size_t>(cols));
+        }
+        // 哈希读入的页面交还给操作系统，生成时再按条带读取(Hand the pages read for hashing back to the OS, generation reads them strip by strip again)
+        mapped.release(0, mapped.size());
+        return hash.update('P').update(cols).update(rows).update(rowHashes.data(), rowHashes.size() * sizeof(std::uint64_t)).digest();
+    }
+
+    // 影响程序主体（工具路径）的参数的哈希，不含头尾参数和模态压缩
+    // Hash of the parameters that affect the program body (the toolpath), without the header and footer parameters and modal compression
+    std::uint64_t hashBody() const {
+        Hash64 hash;
+        hash.update(width).update(height).update(resolution).update(scanMode).update(runTolerance).update(blockLevels).update(powerCurve.getTable());
+        hash.update(flipVertical).update(toneMap.has_value()).update(toneMap.value_or(std::array<std::uint8_t, 256> {})).update(dither.getMethod());
+        hash.update(contourTolerance).update(hatchAngle).update(spiralInsideOut).update(arcFitter ? arcFitter->getTolerance() : -1.0);
+        hash.update(travelOptimization).update(travelBudget.count());
+        return hash.digest();
+    }
+
+    void resetInputFile() {
+        pendingFile.clear();
+        inputFileHash.reset();
+    }
+
+    // 解码推迟的输入文件(Decode the deferred input file)
+    void decodePending() {
+        if(pendingFile.empty()) {
+            return;
+        }
+        mat = cv::imread(pendingFile, cv::IMREAD_GRAYSCALE);
+        if(mat.empty()) {
+            std::println("can not read {}", pendingFile);
+        }
+        pendingFile.clear();
+    }
+
+    std::vector<std::string> makeHeader() const {
+        std::vector<std::string> lines;
+        lines.emplace_back("G17G21G90G54");                                             // XY平面;单位毫米;绝对坐标模式;选择G54坐标系(XY plane; unit mm; absolute coordinate mode; select G54 coordinate system)
+        lines.emplace_back(std::format("F{:d}", feedRate));                             // 移动速度 毫米/每分钟(Moving speed mm/min)
+        lines.emplace_back(std::format("G0 X{:.3f} Y{:.3f}", 0.f, 0.f));                // 设置工作起点及偏移(Set the starting point and offset of the work)
+        lines.emplace_back(std::format("{} S0", kEnumToStringLaserMode()[laserMode]));  // 激光模式(laser mode)
+        if(airPump.has_value()) {
+            lines.emplace_back(std::format("M16 S{:d}", *airPump));  // 打开气泵(Turn on the air pump)
+        }
+        return lines;
+    }
+
+    std::vector<std::string> makeFooter() const {
+        std::vector<std::string> lines;
+        lines.emplace_back("M5");
+        if(airPump.has_value()) {
+            lines.emplace_back("M9");  // 关闭气泵，保持 S300 功率(Turn off air pump and maintain S300 power)
+        }
+        return lines;
+    }
+
+    // 一行（或一条斜线、一圈）扫描结束。流式模式下立即写出并清空，非流式模式下继续累积。
+    // One scanline (or diagonal, or ring) is finished. In streaming mode it is written out and cleared at once, otherwise it keeps accumulating.
+    void endRow() {
+        if(sink != nullptr) {
+            if(arcFitter) {
+                arcFitter->fit(command);
+            }
+            metrics.count(command);
+            writeBody(*sink, command);
+            command.clear();
+        }
+    }
+
+    // 模态压缩从头部建立的状态开始：G0 X0 Y0，S0
+    // Modal compression starts from the state set up by the header: G0 X0 Y0, S0
+    void beginBody() {
+        compressor.reset(Toolpath::Motion::G0, 0, 0, 0);
+    }
+
+    // 写出程序主体，按需经过模态压缩
+    // Write the program body, through modal compression when enabled
+    void writeBody(GCodeSink &out, const Toolpath &path) {
+        auto const scope = metrics.scope("encode");
+        if(!modalCompression) {
+            out.write(path);
+            return;
+        }
+        compressed.clear();
+        compressor.compress(path, compressed);
+        out.write(compressed);
+    }
+
+    void finishBody(GCodeSink &out) {
+        if(modalCompression) {
+            compressed.clear();
+            compressor.finish(compressed);
+            out.write(compressed);
+        }
+    }
+
+    // 本实例的线程池，按 threadCount 创建一次，整个生成过程以及之后的生成都复用其线程。
+    // The thread pool of this instance, created once for threadCount, its threads are reused for the whole job and the jobs that follow.
+    WorkStealingPool &threadPool() {
+        if(!pool || pool->size() != threadCount) {
+            pool = std::make_unique<WorkStealingPool>(threadCount);
+        }
+        return *pool;
+    }
+
+    // 逐行生成，emitRow(y, out, scratch) 把第 y 行写入 out，各行之间互不依赖，scratch 为每个线程自己的缓冲区（默认为游程）。
+    // Generate row by row, emitRow(y, out, scratch) writes row y into out and rows do not depend on each other, scratch is a per-thread buffer (runs by default).
+    // 多线程时把图像分成水平带作为任务交给线程池，调用线程按顺序拼接（流式模式下按顺序写出），输出与单线程逐字节相同。
+    // With several threads the image is split into horizontal bands submitted to the thread pool and the calling thread stitches them in order (writes them in order when streaming), the output is byte-identical to the serial path.
+    template<class Scratch = std::vector<Run>, class EmitRow>
+    void generateRows(int rows, EmitRow &&emitRow) {
+        auto const workers = std::min(threadCount, rows);
+        if(workers <= 1) {
+            Scratch scratch;
+            for(int y = 0; y < rows; ++y) {
+                emitRow(y, command, scratch);
+                endRow();
+            }
+            return;
+        }
+
+        // 每个线程约 8 个带以均衡负载，一个带最多 kBandRows 行；每批提交 batch 个带，未拼接的带最多一批，流式模式下内存有上界
+        // About 8 bands per thread for load balancing and at most kBandRows rows per band; bands are submitted batch at a time so at most one batch waits to be stitched, which bounds memory when streaming
+        constexpr int kBandRows = 64;
+        auto &workPool          = threadPool();
+        int const bandRows      = std::clamp(rows / (workers * 8), 1, kBandRows);
+        int const bands         = (rows + bandRows - 1) / bandRows;
+        int const batch         = workers * 8;
+        if(static_cast<int>(bandSlots.size()) < std::min(batch, bands)) {
+            bandSlots.resize(static_cast<std::size_t>(std::min(batch, bands)));
+        }
+        std::vector<Scratch> scratch(static_cast<std::size_t>(workPool.size()));
+
+        for(int first = 0; first < bands; first += batch) {
+            auto const count = std::min(batch, bands - first);
+            workPool.run(static_cast<std::size_t>(count), [&](int worker, std::size_t job) {
+                auto const band = first + static_cast<int>(job);
+                auto &out       = bandSlots[job];
+                out.clear();
+                auto const scope = metrics.scope("band");
+                for(int y = band * bandRows, end = std::min(rows, y + bandRows); y < end; ++y) {
+                    emitRow(y, out, scratch[static_cast<std::size_t>(worker)]);
+                }
+            });
+            for(int k = 0; k < count; ++k) {
+                command.append(bandSlots[static_cast<std::size_t>(k)]);
+                endRow();
+            }
+        }
+    }
+
+    // 解析已映射的 PGM 文件头：P5，宽，高，最大灰度 (<= 255)，之间可以有注释，最后一个空白字符之后是像素数据
+    // Parse the header of the mapped PGM file: P5, width, height, max gray (<= 255) with optional comments in between, the pixel data follows a single whitespace
+    bool parsePgm() {
+        auto const *p   = reinterpret_cast<const char *>(mapped.data());
+        auto const *end = p + mapped.size();
+        if(mapped.size() < 2 || p[0] != 'P' || p[1] != '5') {
+            return false;
+        }
+        p += 2;
+
+        int values[3] {};
+        for(auto &v: values) {
+            while(p < end && (std::isspace(static_cast<unsigned char>(*p)) || *p == '#')) {
+                if(*p == '#') {
+                    p = std::find(p, end, '\n');
+                } else {
+                    ++p;
+                }
+            }
+            auto const [next, ec] = std::from_chars(p, end, v);
+            if(ec != std::errc {} || v <= 0) {
+                return false;
+            }
+            p = next;
+        }
+        if(p == end || !std::isspace(static_cast<unsigned char>(*p)) || values[2] > 255) {
+            return false;
+        }
+
+        mappedCols   = values[0];
+        mappedRows   = values[1];
+        mappedOffset = static_cast<std::size_t>(p + 1 - reinterpret_cast<const char *>(mapped.data()));
+        return mapped.size() >= mappedOffset + static_cast<std::size_t>(mappedCols) * mappedRows;
+    }
+
+    int sourceCols() const noexcept { return mapped.isOpen() ? mappedCols : mat.cols; }
+
+    int sourceRows() const noexcept { return mapped.isOpen() ? mappedRows : mat.rows; }
+
+    const std::uint8_t *sourceRow(int y) const noexcept {
+        if(mapped.isOpen()) {
+            return mapped.data() + mappedOffset + static_cast<std::size_t>(y) * mappedCols;
+        }
+        return mat.ptr<std::uint8_t>(y);
+    }
+
+    int targetCols() const noexcept { return static_cast<int>(width * resolution); }
+
+    int targetRows() const noexcept { return static_cast<int>(height * resolution); }
+
+    // 整幅预处理到目标尺寸，供需要随机访问整幅图像的扫描方式使用。结果放在条带缓冲中，同一次生成内只计算一次。
+    // Preprocess the whole image at the target size, for scan modes that need random access to the whole image. The result lives in the strip buffer and is computed once per job.
+    cv::Mat resized() {
+        auto const rows = targetRows();
+        auto const cols = targetCols();
+        if(strip.rows != rows || strip.cols != cols) {
+            strip.create(rows, cols, CV_8UC1);
+            stripStart = -1;
+        }
+        if(stripStart != 0) {
+            std::vector<AreaResampler> resamplers;
+            prepare(resamplers, 0, rows, strip);
+            stripStart = 0;
+        }
+        return strip;
+    }
+
+    // 按条带预处理图像，f(strip, y0) 中 strip 为目标图像从第 y0 行开始的若干行。
+    // Preprocess the image strip by strip, in f(strip, y0) strip holds the rows of the target image starting at row y0.
+    // 条带缓冲区重复使用；映射输入中已经用完的源行会交还给操作系统。只有一个条带时多次遍历不会重复计算。
+    // The strip buffer is reused and source rows of a mapped input that are no longer needed are handed back to the OS. With a single strip, repeated passes do not compute it again.
+    template<class F>
+    void forEachStrip(F &&f) {
+        auto const rows = targetRows();
+        auto const cols = targetCols();
+        if(strip.rows != std::min(stripRows, rows) || strip.cols != cols) {
+            strip.create(std::min(stripRows, rows), cols, CV_8UC1);
+            stripStart = -1;
+        }
+
+        std::vector<AreaResampler> resamplers;
+        std::size_t released = 0;
+        std::size_t tail     = mappedOffset + static_cast<std::size_t>(mappedCols) * mappedRows;
+        for(int y0 = 0; y0 < rows; y0 += strip.rows) {
+            auto const y1 = std::min(rows, y0 + strip.rows);
+            if(spliceBand(resamplers, y0, y1)) {
+                stripStart = -1;
+                continue;
+            }
+            if(stripStart != y0) {
+                prepare(resamplers, y0, y1, strip);
+                stripStart = y0;
+            }
+
+            if(mapped.isOpen() && y1 < rows && !resamplers.empty()) {
+                // 翻转时从文件末尾向前读取，交还的是尾部(When flipped the file is read back to front and the tail is handed back)
+                auto const first = resamplers.front().sourceRows(y1, y1 + 1).first;
+                if(flipVertical) {
+                    auto const used = mappedOffset + static_cast<std::size_t>(mappedRows - first) * mappedCols;
+                    mapped.release(used, tail - used);
+                    tail = used;
+                } else {
+                    auto const used = mappedOffset + static_cast<std::size_t>(first) * mappedCols;
+                    mapped.release(released, used - released);
+                    released = used;
+                }
+            }
+            f(strip.rowRange(0, y1 - y0), y0);
+        }
+    }
+
+    // 预处理目标图像的 [y0, y1) 行到 out：面积缩放、垂直翻转和灰度查找表在同一遍内完成，按输出行分给多个线程，之后抖动。
+    // Preprocess rows [y0, y1) of the target image into out: area resampling, vertical flip and the gray lookup table are fused into one pass split by output rows across threads, followed by dithering.
+    // 每个线程使用自己的 resampler（保存在 resamplers 中供后续条带复用）；输出行与分法无关，结果与线程数无关。
+    // Each thread uses its own resampler (kept in resamplers for the following strips); output rows do not depend on the split, so the result does not depend on the thread count.
+    void prepare(std::vector<AreaResampler> &resamplers, int y0, int y1, cv::Mat &out) {
+        {
+            auto const scope = metrics.scope("resize");
+            auto const rows  = y1 - y0;
+            // 每个线程至少 64K 像素，小图不值得开线程(At least 64K pixels per thread, small images are not worth the threads)
+            auto const workers = std::clamp(static_cast<int>(static_cast<std::int64_t>(rows) * out.cols / 65536), 1, std::min(threadCount, rows));
+            while(static_cast<int>(resamplers.size()) < workers) {
+                resamplers.emplace_back(sourceCols(), sourceRows(), targetCols(), targetRows());
+            }
+
+            auto const *lut = toneMap ? toneMap->data() : nullptr;
+            auto const work = [&](int t) {
+                auto const r0 = y0 + static_cast<int>(static_cast<std::int64_t>(rows) * t / workers);
+                auto const r1 = y0 + static_cast<int>(static_cast<std::int64_t>(rows) * (t + 1) / workers);
+                resamplers[t].resample(r0, r1, [this](int y) { return sourceRow(flipVertical ? sourceRows() - 1 - y : y); }, out.ptr<std::uint8_t>(r0 - y0), out.step, lut);
+            };
+            if(workers == 1) {
+                work(0);
+            } else {
+                threadPool().run(static_cast<std::size_t>(workers), [&](int, std::size_t t) { work(static_cast<int>(t)); });
+            }
+        }
+
+        if(dither.getMethod() != Dither::Method::None) {
+            // 每遍从第 0 行重新开始，误差在条带之间延续(Every pass restarts at row 0, the error carries over between strips)
+            auto const scope = metrics.scope("dither");
+            if(y0 == 0) {
+                dither.setThreadCount(threadCount);
+                dither.reset();
+            }
+            dither.apply(out.ptr<std::uint8_t>(0), out.step, y1 - y0, out.cols);
+        }
+    }
+
     void matToGCode() {
-        assert(mat.channels() == 1);
         assert(std::isgreaterequal(resolution, 1e-5f));
         assert(!((width * resolution < 1.0) || (height * resolution < 1.0)));
+        decodePending();
+        if(!hasInput()) {
+            std::println("input image is empty or not 8-bit grayscale");
+            return;
+        }
+        stripStart = -1;
 
         // different conversion strategy functions are called here
 
         switch(scanMode) {
             case ScanMode::Unidirection: unidirectionOptStrategy(); break;
             case ScanMode::Bidirection: bidirectionOptStrategy(); break;
-            case ScanMode::Diagonal:  diagonalStrategy(); break;
-            case ScanMode::Spiral: spiralStrategy(); break;
-            case ScanMode::Block: break;
+            case ScanMode::Diagonal: diagonalOptStrategy(true); break;
+            case ScanMode::DiagonalUnidirection: diagonalOptStrategy(false); break;
+            case ScanMode::Hatch: hatchStrategy(); break;
+            case ScanMode::Contour: contourStrategy(); break;
+            case ScanMode::Spiral: spiralOptStrategy(); break;
+            case ScanMode::Block: blockStrategy(); break;
+            case ScanMode::BidirectionStd: bidirectionStdOptStrategy(); break;
         }
     }
 
@@ -137,73 +1036,41 @@ private:
     // 未做任何优化处理，像素和G0、G1一一映射对应。
     // No optimization has been done, and pixels are mapped one-to-one to G0 and G1.
     void unidirectionStrategy() {
-        cv::Mat image;
-        cv::resize(mat, image, cv::Size(static_cast<int>(width * resolution), static_cast<int>(height * resolution)));
+        cv::Mat image = resized();
         for(int y = 0; y < image.rows; ++y) {
-            command.emplace_back(G0(0, y / resolution, std::nullopt).toString());
+            command.emplace_back(G0(0, y / resolution, std::nullopt));
             for(int x = 0; x < image.cols; ++x) {
                 auto pixel = image.at<uchar>(y, x);
                 if(pixel == 255) {
                     command.emplace_back(G0(x / resolution, std::nullopt, std::nullopt));
                 } else {
-                    auto power = static_cast<int>((1.0 - static_cast<double>(pixel) / 255.0) * 1000.0);
-                    command.emplace_back(G1(x / resolution, std::nullopt, power));
+                    command.emplace_back(G1(x / resolution, std::nullopt, power(pixel)));
                 }
             }
+            endRow();
         }
     }
 
     // 单向扫描优化版本V1
     // One-way scanning optimized version V1
-    // 删除多余空行程，这里空行程指连续的无用的G0。
-    // Delete excess empty strokes, where empty strokes refer to continuous useless G0.
+    // 每行切分为游程：去掉行首行尾的空行程，中间连续空白合并为一个 G0，灰度相同（或在容差内）的连续像素合并为一个 G1。
+    // Each row is split into runs: leading and trailing blanks are skipped, inner blank runs become one G0 and consecutive pixels of equal (or within tolerance) gray level become one G1.
     void unidirectionOptStrategy() {
-        cv::Mat image;
-        cv::resize(mat, image, cv::Size(static_cast<int>(width * resolution), static_cast<int>(height * resolution)));
-        int offset = 0;  // The frist consecutive G0
-        int length = 0;
-        for(int y = 0; y < image.rows; ++y) {
-            command.emplace_back(G0(offset / resolution, y / resolution, std::nullopt).toString());
-            for(int x = 0; x < image.cols; ++x) {
-                auto pixel = image.at<uchar>(y, x);
-                length     = 0;
-                if(pixel == 255) {
-                    while(++x < image.cols && image.at<std::uint8_t>(y, x) == 255) {
-                        length++;
-                    }
-                    --x;
-
-                    // Whether continuous GO exists
-                    if(length) {
-                        if(x - length == 0) {  // skip The frist consecutive G0
-                            offset = length;
-                            command.emplace_back(G0((x) / resolution, std::nullopt, std::nullopt));
-                            continue;
-                        }
-
-                        if(x == image.cols - 1) {  // skip The last consecutive G0
-                            command.emplace_back(G0((x - length) / resolution, std::nullopt, std::nullopt));
-                            continue;
-                        }
-                        // Continuous GO
-                        command.emplace_back(G0(x / resolution, std::nullopt, std::nullopt));
-                    } else {
-                        // Independent GO
-                        command.emplace_back(G0(x / resolution, std::nullopt, std::nullopt));
-                    }
-                } else {
-                    auto power = static_cast<int>((1.0 - static_cast<double>(pixel) / 255.0) * 1000.0);
-                    command.emplace_back(G1(x / resolution, std::nullopt, power));
-                }
-            }
-        }
+        forEachStrip([&](const cv::Mat &image, int y0) {
+            generateRows(image.rows, [&](int y, Toolpath &out, std::vector<Run> &runs) {
+                spliceRow(image.ptr<std::uint8_t>(y), image.cols, y0 + y, out, [&] {
+                    runs.clear();
+                    extractRuns({image.ptr<std::uint8_t>(y), static_cast<std::size_t>(image.cols)}, runTolerance, runs);
+                    emitRuns(runs, y0 + y, false, out);
+                });
+            });
+        });
     }
 
     // 双向扫描
     // Bidirectional scanning
     void bidirectionStrategy() {
-        cv::Mat image;
-        cv::resize(mat, image, cv::Size(static_cast<int>(width * resolution), static_cast<int>(height * resolution)));
+        cv::Mat image = resized();
 
         for(int y = 0; y < image.rows; ++y) {
             bool isEven = !(y & 1);
@@ -216,295 +1083,516 @@ private:
                 if(auto const pixel = image.at<cv::uint8_t>(y, x); pixel == 255) {
                     command.emplace_back(G0 {x / resolution, std::nullopt, std::nullopt});
                 } else {
-                    auto power = static_cast<int>((1.0 - static_cast<double>(pixel) / 255.0) * 1000.0);
-                    command.emplace_back(G1(x / resolution, std::nullopt, power));
+                    command.emplace_back(G1(x / resolution, std::nullopt, power(pixel)));
                 }
             }
+            endRow();
         }
     }
 
     // 双向扫描优化
     // Bidirectional scanning optimization
+    // 偶数行从左到右，奇数行从右到左，每行的游程处理与单向扫描相同。
+    // Even rows run left to right and odd rows right to left, each row is handled by the same run code as the one-way scan.
+    // 上一行结束后的 Y 轴移动合并到下一条非空行的第一条 G0 中，因此行与行之间不再需要额外的状态。
+    // The Y move after a row is folded into the first G0 of the next non-blank row, so no state is carried between rows.
     void bidirectionOptStrategy() {
-        cv::Mat image;
-        cv::resize(mat, image, cv::Size(static_cast<int>(width * resolution), static_cast<int>(height * resolution)));
+        forEachStrip([&](const cv::Mat &image, int y0) {
+            generateRows(image.rows, [&](int y, Toolpath &out, std::vector<Run> &runs) {
+                spliceRow(image.ptr<std::uint8_t>(y), image.cols, y0 + y, out, [&] {
+                    runs.clear();
+                    extractRuns({image.ptr<std::uint8_t>(y), static_cast<std::size_t>(image.cols)}, runTolerance, runs);
+                    emitRuns(runs, y0 + y, (y0 + y) & 1, out);
+                });
+            });
+        });
+    }
+
+    // 把一行的游程写成 G 代码，坐标取像素边界。reverse 为 true 时从右向左。全空白的行不输出任何指令。
+    // Write the runs of one row as G-code, coordinates are pixel edges. When reverse is true the row runs right to left. Blank rows emit nothing.
+    void emitRuns(std::span<const Run> runs, int y, bool reverse, Toolpath &out) const {
+        auto const burn  = [](const Run &r) { return r.value != 255; };
+        auto const first = std::ranges::find_if(runs, burn);
+        if(first == runs.end()) {
+            return;
+        }
+        auto const last = std::ranges::find_if(runs | std::views::reverse, burn);
 
-        bool leftToRight {false};
-        bool rightToLeft {false};
+        auto const mm = [this](int v) { return Toolpath::toMicro(v / resolution); };
+        if(!reverse) {
+            out.push(Toolpath::Motion::G0, mm(first->start), mm(y), std::nullopt);
+            for(auto it = first; it != last.base(); ++it) {
+                out.push(burn(*it) ? Toolpath::Motion::G1 : Toolpath::Motion::G0, mm(it->end), std::nullopt, burn(*it) ? std::optional(power(it->value)) : std::nullopt);
+            }
+        } else {
+            out.push(Toolpath::Motion::G0, mm(last->end), mm(y), std::nullopt);
+            for(auto it = last; it.base() != first; ++it) {
+                out.push(burn(*it) ? Toolpath::Motion::G1 : Toolpath::Motion::G0, mm(it->start), std::nullopt, burn(*it) ? std::optional(power(it->value)) : std::nullopt);
+            }
+        }
+    }
 
-        // 可以使用 C++ 迭代器查找距离
-        // https://en.cppreference.com/w/cpp/iterator/advance
-        // https://en.cppreference.com/w/cpp/iterator/prev
+    // 灰度转激光功率 S，查表(Gray level to laser power S, by table lookup)
+    int power(std::uint8_t pixel) const noexcept {
+        return powerCurve(pixel);
+    }
 
-        for(int y = 0; y < image.rows; ++y) {
-            bool isEven = !(y & 1);
-            int start   = isEven ? 0 : image.cols - 1;
-            int end     = isEven ? image.cols : -1;
-            int step    = isEven ? 1 : -1;
+    // 双向扫描使用C++标准库优化
+    // Bidirectional scanning uses C++ standard library optimization
+    // 按蛇形顺序把所有像素视为一个序列：连续的空白只保留最后一个 G0，其余像素各输出一个 G1。
+    // All pixels are treated as one sequence in serpentine order: consecutive blanks only keep their last G0 and every other pixel emits one G1.
+    // 单次遍历，直接在 cv::Mat 的行上使用视图，不复制数据，额外内存为 O(1)。
+    // Single pass over views of the cv::Mat rows without copying, O(1) extra memory.
+    void bidirectionStdOptStrategy() {
+        auto const rows    = targetRows();
+        auto const cols    = targetCols();
+        auto const columns = std::views::iota(0, cols);
+        auto const last    = [&](int y) { return (y & 1) ? 0 : cols - 1; };  // 第 y 行最后扫描的列(The last scanned column of row y)
+        std::uint8_t previous = 0;                                            // 上一条带最后一行最后扫描的像素(The last scanned pixel of the previous strip's last row)
 
-            for(int x = start; x != end; x += step) {
-                if(auto const pixel = image.at<cv::uint8_t>(y, x); pixel == 255) {
-                    // 偶数从左到右扫描
-                    // 奇数从右到左扫描
-                    if(isEven) {
-                        // 从左到右寻找连续的G0
-                        // |----->
-                        int length {0};
-                        while(++x < end && image.at<cv::uint8_t>(y, x) == 255) {
-                            length++;
-                        }
-                        --x;
-
-                        // 使用 do{}while(false) 结构，最后统一判断是否会更好
-                        // find
-                        if(length) {
-                            // 起点存在连续G0
-                            if(x - length == 0) {
-                                // 此时需要把奇数行延迟的Y轴移动进行上移操作
-                                if(rightToLeft) {
-                                    command.emplace_back(G0((x+1) / resolution, y / resolution, std::nullopt));
-                                    rightToLeft = false;
-                                } else {
-                                    // 偶数从左到右在起点永远不会向上移动，所以这里不需要 y
-                                    command.emplace_back(G0 {(x+1) / resolution, std::nullopt, std::nullopt});
-                                }
-                                continue;
-                            }
+        forEachStrip([&](const cv::Mat &image, int y0) {
+            generateRows(image.rows, [&](int i, Toolpath &out, std::vector<Run> &) {
+                auto const y   = y0 + i;
+                auto const row = std::span(image.ptr<std::uint8_t>(i), image.cols);
+                auto const mm  = [this](int v) { return Toolpath::toMicro(v / resolution); };
 
-                            // 终点存在连续G0
-                            if(x == image.cols - 1) {
-                                // 终点需要向上移动，但这个移动我们放在奇数行处理，所以这里只需要做好标记即可。
-                                leftToRight = true;
-                                command.emplace_back(G0(((x+1) - length) / resolution, std::nullopt, std::nullopt));
-                                continue;
-                            }
+                // 待定的空白 G0：只有当下一个像素不是空白时才输出。上一行以空白结束时，它延续到本行。
+                // The pending blank G0 is only emitted when the next pixel is not blank. If the previous row ended with a blank, it carries over into this row.
+                std::optional<std::pair<int, int>> pending;
+                if(y > 0 && (i > 0 ? image.ptr<std::uint8_t>(i - 1)[last(y - 1)] : previous) == 255) {
+                    pending = {last(y - 1), y - 1};
+                }
 
-                            // 中间段存在连续从左到右方向的G0
-                            // 中间段不需要向上移动
-                            command.emplace_back(G0((x+1) / resolution, std::nullopt, std::nullopt));
+                auto const visit = [&](auto &&order) {
+                    for(int x: order) {
+                        if(auto const pixel = row[x]; pixel == 255) {
+                            pending = {x, y};
                         } else {
-                            // 没有找到连续的G0
-                            // 终点唯一的G0,需要向上移动，这里做标记放到奇数行移动。
-                            if(x == image.cols - 1) {
-                                leftToRight = true;
-                            } else if(x == start) {
-                                command.emplace_back(G0((x+1) / resolution, y / resolution, std::nullopt));
-                                rightToLeft = false;
-                                continue;
+                            if(pending) {
+                                out.push(Toolpath::Motion::G0, mm(pending->first), mm(pending->second), std::nullopt);
+                                pending = std::nullopt;
                             }
-                            command.emplace_back(G0((x+1) / resolution, std::nullopt, std::nullopt));
+                            out.push(Toolpath::Motion::G1, mm(x), mm(y), power(pixel));
                         }
-                    } else {
-                        // <-----|
-                        // 从右到左寻找连续的G0 此时起点在右边，终点在左边
-                        int length {0};
-                        while(--x > end && image.at<cv::uint8_t>(y, x) == 255) {
-                            length++;
-                        }
-                        ++x;
-
-                        if(length) {
-                            // 起点存在连续的G0
-                            if(x + length == start) {
-                                // 此时需要把偶数行延迟的Y轴移动进行上移操作
-                                if(leftToRight) {
-                                    command.emplace_back(G0(x / resolution, y / resolution, std::nullopt));
-                                    leftToRight = false;
-                                } else {
-                                    // 标记
-                                    command.emplace_back(G0(x / resolution, std::nullopt, std::nullopt));
-                                }
-                                continue;
-                            }
+                    }
+                };
+                (y & 1) ? visit(columns | std::views::reverse) : visit(columns);
 
-                            // 终点存在连续的G0
-                            if(x == 0) {
-                                rightToLeft = true;
-                                ;
-                                continue;
-                            }
-                            command.emplace_back(G0(x / resolution, std::nullopt, std::nullopt));
-                        } else {
-                            // 没有找到连续的G0
-                            // 终点需要向上移动
-                            if(x == 0) {
-                                rightToLeft = true;
-                            } else if(x == start) {
-                                // 起点也需要处理上一行的y轴移动
-                                if(leftToRight) {
-                                    command.emplace_back(G0(x / resolution, y / resolution, std::nullopt));
-                                    leftToRight = false;
-                                }
-                                continue;
-                            }
-                            command.emplace_back(G0(x / resolution, std::nullopt, std::nullopt));
+                // 序列末尾的空白 G0 保留
+                // The blank G0 at the very end of the sequence is kept
+                if(pending && y == rows - 1) {
+                    out.push(Toolpath::Motion::G0, mm(pending->first), mm(pending->second), std::nullopt);
+                }
+            });
+            previous = image.ptr<std::uint8_t>(image.rows - 1)[last(y0 + image.rows - 1)];
+        });
+    }
+
+    // 分块（灰度分层）扫描
+    // Block (gray-level layering) scanning
+    // 一遍预处理建立灰度直方图、每个级别用到的列范围，以及每个级别在每个用到的行上的位图，然后每个级别以固定功率单独雕刻一遍，跳过空行和空列。
+    // A single preprocessing pass builds the gray histogram, the column range of each level and a bitmask row for every level on every row it uses, then each level is engraved as its own pass at a fixed power, skipping blank rows and columns.
+    // 每一遍内功率不变，机器可以全速运行而不必逐像素调整功率。位图行只为用到的 (级别, 行) 分配，每个像素只属于一个级别，不必为每个级别重新缩放和抖动。
+    // Power never changes within a pass, so the machine can run at full feed without per-pixel power changes. Bitmask rows are only allocated for (level, row) pairs in use, every pixel belongs to one level and the image is never resized or dithered again per level.
+    void blockStrategy() {
+        auto const rows   = targetRows();
+        auto const cols   = targetCols();
+        auto const levels = blockLevels;
+        auto const words  = (cols + 63) / 64;
+        std::array<std::uint64_t, 256> histogram {};
+        std::vector<int> minX(levels, cols), maxX(levels, -1);
+        // 每个级别的位图行，slots 为 (级别, 行) 对应的位图行序号，-1 表示该行没有这个级别
+        // Bitmask rows of every level, slots holds the bitmask row index of a (level, row) pair, -1 when the row has no pixel of the level
+        std::vector<std::vector<std::uint64_t>> masks(levels);
+        std::vector<std::int32_t> slots(static_cast<std::size_t>(levels) * rows, -1);
+
+        std::array<std::uint8_t, 256> levelOf {};
+        for(int g = 0; g < 255; ++g) {
+            levelOf[g] = static_cast<std::uint8_t>(g * levels / 255);
+        }
+
+        forEachStrip([&](const cv::Mat &image, int y0) {
+            for(int y = 0; y < image.rows; ++y) {
+                auto const *row = image.ptr<std::uint8_t>(y);
+                auto *slot      = slots.data() + y0 + y;
+                for(int x = 0; x < image.cols;) {
+                    // 整段跳过空白(Skip blank spans as a whole)
+                    auto const next = RowScanner::findOutside(row, x, image.cols, 255, 255);
+                    histogram[255] += static_cast<std::uint64_t>(next - x);
+                    for(x = next; x < image.cols && row[x] != 255; ++x) {
+                        auto const l = levelOf[row[x]];
+                        auto &mask   = masks[l];
+                        auto &index  = slot[static_cast<std::size_t>(l) * rows];
+                        if(index < 0) {
+                            index = static_cast<std::int32_t>(mask.size() / words);
+                            mask.resize(mask.size() + words, 0);
                         }
+                        mask[static_cast<std::size_t>(index) * words + x / 64] |= std::uint64_t {1} << (x % 64);
+                        ++histogram[row[x]];
+                        minX[l] = std::min(minX[l], x);
+                        maxX[l] = std::max(maxX[l], x);
                     }
-                } else {
-                    auto power = static_cast<int>((1.0 - static_cast<double>(pixel) / 255.0) * 1000.0);
-                    // 处理G1 开头和结尾情况
-                    if(isEven) {
-                        // 从左到右
-                        if(x == start) {
-                            if(rightToLeft) {
-                                command.emplace_back(G0 {(x+1) / resolution, y / resolution, power});  // 最大激光功率 S=1000
-                                rightToLeft = false;
-                                continue;
+                }
+            }
+        });
+
+        std::vector<Run> runs;
+        for(int l = 0; l < levels; ++l) {
+            if(maxX[l] < 0) {
+                continue;  // 空级别(Empty level)
+            }
+
+            // 级别的代表灰度取直方图加权平均
+            // The representative gray of a level is the histogram-weighted mean
+            std::uint64_t count = 0, sum = 0;
+            for(int g = 0; g < 255; ++g) {
+                if(levelOf[g] == l) {
+                    count += histogram[g];
+                    sum += histogram[g] * static_cast<std::uint64_t>(g);
+                }
+            }
+            auto const gray = static_cast<std::uint8_t>((sum + count / 2) / count);
+
+            auto const w0    = minX[l] / 64;
+            auto const w1    = maxX[l] / 64;
+            auto const *slot = slots.data() + static_cast<std::size_t>(l) * rows;
+            bool reverse     = false;
+            for(int y = 0; y < rows; ++y) {
+                if(slot[y] < 0) {
+                    continue;  // 空行(Blank row)
+                }
+
+                // 从位图中提取置位的游程，中间的空隙作为空白游程
+                // Extract runs of set bits from the bitmask, gaps in between become blank runs
+                auto const *row = masks[l].data() + static_cast<std::size_t>(slot[y]) * words;
+                runs.clear();
+                int start = -1;
+                int prev  = 0;
+                auto const close = [&](int end) {
+                    if(prev < start) {
+                        runs.push_back({prev, start, 255});
+                    }
+                    runs.push_back({start, end, gray});
+                    prev  = end;
+                    start = -1;
+                };
+                for(int w = w0; w <= w1; ++w) {
+                    auto const word = row[w];
+                    for(int b = 0; b < 64;) {
+                        if(start < 0) {
+                            auto const rest = word >> b;
+                            if(rest == 0) {
+                                break;
                             }
-                        } else if(x == image.cols - 1) {
-                            // 终点需要标记
-                            leftToRight = true;
-                        }
-                        command.emplace_back(G1 {(x+1) / resolution, std::nullopt, power});  // 最大激光功率 S=1000
-                    } else {
-                        // 从右到左
-                        if(x == start) {
-                            if(leftToRight) {
-                                command.emplace_back(G0 {x / resolution, y / resolution, power});  // 最大激光功率 S=1000
-                                leftToRight = false;
-                                continue;
+                            b += std::countr_zero(rest);
+                            start = w * 64 + b;
+                        } else {
+                            auto const rest = ~word >> b;
+                            if(rest == 0) {
+                                break;
                             }
-                        } else if(x == 0) {
-                            // 终点需要标记
-                            rightToLeft = true;
+                            b += std::countr_zero(rest);
+                            close(w * 64 + b);
                         }
-                        command.emplace_back(G1 {x / resolution, std::nullopt, power});  // 最大激光功率 S=1000
                     }
-                }  // end if G0
-            }      // end for x
-        }          // end for y
+                }
+                if(start >= 0) {
+                    close(std::min(cols, (w1 + 1) * 64));
+                }
+
+                emitRuns(runs, y, reverse, command);
+                reverse = !reverse;
+                endRow();
+            }
+            // 用完的级别立即释放位图(Free the bitmask of a finished level at once)
+            std::vector<std::uint64_t>().swap(masks[l]);
+        }
     }
 
-    // 双向扫描使用C++标准库优化
-    // Bidirectional scanning uses C++ standard library optimization
-    void bidirectionStdOptStrategy() {
-        cv::Mat image;
-        cv::resize(mat, image, cv::Size(static_cast<int>(width * resolution), static_cast<int>(height * resolution)));
+    // 斜向扫描优化
+    // Diagonal scanning optimization
+    // 先把图像按分块错切到连续缓冲区中，每条反对角线 (i + j = k) 在内存中连续，按列号 j 索引；之后每条斜线与行扫描一样切分为游程。
+    // The image is first skewed tile by tile into a flat buffer where every anti-diagonal (i + j = k) is contiguous and indexed by column j; each diagonal is then split into runs like a row.
+    // 像素 (i, j) 沿斜线从左下角 (j, i + 1) 走到右上角 (j + 1, i)，因此一段游程只需一条斜向 G0/G1。
+    // Pixel (i, j) is crossed from its bottom-left corner (j, i + 1) to its top-right corner (j + 1, i), so one run needs a single diagonal G0/G1.
+    // bidirection 为 true 时偶数斜线向右上、奇数斜线向左下，否则全部向右上；斜线之间互不依赖，可以多线程生成。
+    // With bidirection even diagonals run up-right and odd ones down-left, otherwise all run up-right; diagonals are independent and can be generated in parallel.
+    void diagonalOptStrategy(bool bidirection) {
+        cv::Mat image = resized();
+        auto const rows      = image.rows;
+        auto const cols      = image.cols;
+        auto const diagonals = rows + cols - 1;
+        auto const first     = [&](int k) { return std::max(0, k - rows + 1); };  // 斜线 k 的第一列(First column of diagonal k)
 
-        struct G {
-            int x, y, v;  // <X>.<Y>.<Pixel>
-        };
+        std::vector<std::size_t> offset(static_cast<std::size_t>(diagonals) + 1, 0);
+        for(int k = 0; k < diagonals; ++k) {
+            offset[k + 1] = offset[k] + static_cast<std::size_t>(std::min(k, cols - 1) - first(k) + 1);
+        }
 
-        std::vector<std::vector<G>> lines;
-        for(int y = 0; y < image.rows; y++) {
-            std::vector<G> line;
-            for(int x = 0; x < image.cols; x++) {
-                auto pixel = image.at<uchar>(y, x);
-                line.emplace_back(x, y, pixel);
+        // 分块错切：块内按行读取，写入位置分散在块宽条斜线上，与分块转置一样保持在缓存内
+        // Tiled skew: tiles are read row by row and the writes spread over tile-width diagonals, staying in cache like a tiled transpose
+        constexpr int tile = 64;
+        std::vector<std::uint8_t> skewed(offset.back());
+        for(int i0 = 0; i0 < rows; i0 += tile) {
+            for(int j0 = 0; j0 < cols; j0 += tile) {
+                for(int i = i0, i1 = std::min(rows, i0 + tile); i < i1; ++i) {
+                    auto const *row = image.ptr<std::uint8_t>(i);
+                    for(int j = j0, j1 = std::min(cols, j0 + tile); j < j1; ++j) {
+                        skewed[offset[i + j] + static_cast<std::size_t>(j - first(i + j))] = row[j];
+                    }
+                }
             }
-            lines.emplace_back(line);
         }
+        image.release();
 
-        // process lines vector
-        // 数据预处理
-        for(bool isEven = true; auto &line: lines) {
-            if(!isEven) {
-                // 奇数调转方向
-                std::ranges::reverse(line.begin(), line.end());
+        generateRows(diagonals, [&](int k, Toolpath &out, std::vector<Run> &runs) {
+            auto const j0 = first(k);
+            runs.clear();
+            extractRuns({skewed.data() + offset[k], offset[k + 1] - offset[k]}, runTolerance, runs);
+            emitLineRuns(runs, bidirection && (k & 1), out, [&](int t) {
+                auto const j = j0 + t;
+                return std::pair {Toolpath::toMicro(j / resolution), Toolpath::toMicro((k + 1 - j) / resolution)};
+            });
+        });
+    }
+
+    // 把一条直线上的游程写成 G 代码，point(t) 为游程边界 t 处的坐标（微米），每条指令都带 X 和 Y。全空白时不输出任何指令。
+    // Write the runs along a straight line as G-code, point(t) is the coordinate (micrometre) of run boundary t and every command carries X and Y. Blank lines emit nothing.
+    template<class Point>
+    void emitLineRuns(std::span<const Run> runs, bool reverse, Toolpath &out, Point &&point) const {
+        auto const burn  = [](const Run &r) { return r.value != 255; };
+        auto const first = std::ranges::find_if(runs, burn);
+        if(first == runs.end()) {
+            return;
+        }
+        auto const last = std::ranges::find_if(runs | std::views::reverse, burn);
+
+        auto const move = [&](const Run &r, int t) {
+            auto const [x, y] = point(t);
+            out.push(burn(r) ? Toolpath::Motion::G1 : Toolpath::Motion::G0, x, y, burn(r) ? std::optional(power(r.value)) : std::nullopt);
+        };
+        if(!reverse) {
+            auto const [x, y] = point(first->start);
+            out.push(Toolpath::Motion::G0, x, y, std::nullopt);
+            for(auto it = first; it != last.base(); ++it) {
+                move(*it, it->end);
+            }
+        } else {
+            auto const [x, y] = point(last->end);
+            out.push(Toolpath::Motion::G0, x, y, std::nullopt);
+            for(auto it = last; it.base() != first; ++it) {
+                move(*it, it->start);
             }
-            isEven = !isEven;
         }
+    }
 
-        // 经过上述处理，数据的顺序现在一致了。
-        // 现在只需按顺序处理，删除从左到右连续的G0，仅保留连续G0最右边的元素。
+    // 螺旋扫描优化
+    // Spiral scanning optimization
+    // 从外到里每一圈依次为上边（向右）、右边（向下）、下边（向左）、左边（向上）；行边直接取图像行，列边取转置图像的行，因此每条边都是连续内存，按行扫描的方式切分为游程。
+    // Outside-in, every ring is its top edge (rightwards), right edge (downwards), bottom edge (leftwards) and left edge (upwards) in that order; row edges are image rows and column edges are rows of the transposed image, so every edge is contiguous memory and is split into runs like a row.
+    // 坐标与行扫描一致取像素左上角一侧的边：像素 (i, j) 水平方向覆盖 X [j, j + 1]，垂直方向覆盖 Y [i, i + 1]。全白的边和圈不输出任何指令。
+    // Coordinates follow the row scan and use the top-left side of a pixel: pixel (i, j) covers X [j, j + 1] horizontally and Y [i, i + 1] vertically. Completely white edges and rings emit nothing.
+    // 从里到外时圈的顺序和圈内的走向都反过来；圈之间互不依赖，可以多线程生成。
+    // Inside-out reverses both the ring order and the direction within each ring; rings are independent and can be generated in parallel.
+    void spiralOptStrategy() {
+        cv::Mat image = resized();
+        cv::Mat transposed;
+        cv::transpose(image, transposed);
 
-        // 使用 std::ranges::join 合并嵌套的向量
-        // std::back_inserter
+        auto const rings = (std::min(image.rows, image.cols) + 1) / 2;
+        auto const mm    = [this](int v) { return Toolpath::toMicro(v / resolution); };
 
-        // auto container = std::ranges::join_view(lines);
+        struct Edge {
+            const std::uint8_t *pixels;
+            int length;
+            bool reverse;
+            bool horizontal;
+            int fixed;  // 边所在的行或列(The row or column of the edge)
+            int start;  // 第一个像素的列或行(Column or row of the first pixel)
+        };
 
-        std::vector<G> container;
-        for(auto &line: lines) {
-            container.insert(container.end(), line.begin(), line.end());
-        }
+        generateRows(rings, [&](int n, Toolpath &out, std::vector<Run> &runs) {
+            auto const r      = spiralInsideOut ? rings - 1 - n : n;
+            auto const top    = r;
+            auto const left   = r;
+            auto const bottom = image.rows - 1 - r;
+            auto const right  = image.cols - 1 - r;
 
-        while(true) {
-            auto it = std::ranges::adjacent_find(container.begin(), container.end(), [](auto left, auto right) -> bool { return left.v == 255 && left.v == right.v; });
-            if(it == container.end()) {
-                break;
+            // 上边向右，右边向下，下边向左，左边向上(Top runs right, right runs down, bottom runs left, left runs up)
+            std::array<Edge, 4> edges {};
+            int count = 0;
+            edges[count++] = {image.ptr<std::uint8_t>(top) + left, right - left + 1, false, true, top, left};
+            edges[count++] = {transposed.ptr<std::uint8_t>(right) + top + 1, bottom - top, false, false, right, top + 1};
+            if(top < bottom) {
+                edges[count++] = {image.ptr<std::uint8_t>(bottom) + left, right - left, true, true, bottom, left};
+            }
+            if(left < right) {
+                edges[count++] = {transposed.ptr<std::uint8_t>(left) + top + 1, std::max(0, bottom - top - 1), true, false, left, top + 1};
             }
-            container.erase(it);
-        }
 
-        for(auto g: container) {
-            if(g.v == 255) {
-                command.emplace_back(G0 {g.x, g.y, std::nullopt});
-            } else {
-                command.emplace_back(G1 {g.x, g.y, 1000});
+            for(int e = 0; e < count; ++e) {
+                auto const &edge = edges[spiralInsideOut ? count - 1 - e : e];
+                if(edge.length <= 0) {
+                    continue;
+                }
+                runs.clear();
+                extractRuns({edge.pixels, static_cast<std::size_t>(edge.length)}, runTolerance, runs);
+                emitLineRuns(runs, edge.reverse != spiralInsideOut, out, [&](int t) {
+                    return edge.horizontal ? std::pair {mm(edge.start + t), mm(edge.fixed)} : std::pair {mm(edge.fixed), mm(edge.start + t)};
+                });
             }
-        }
+        });
     }
 
-    void internal(cv::Mat &image, auto x /*width*/, auto y /*height*/,bool isEven) {
-        auto pixel = image.at<cv::uint8_t>(y, x);
-        if(pixel == 255) {
-            command.emplace_back(G0(isEven ? (x + 1) / resolution : x / resolution, y / resolution, std::nullopt));
-        } else {
-            auto power = static_cast<int>((1.0 - static_cast<double>(pixel) / 255.0) * 1000.0);
-            command.emplace_back(G1(isEven ? (x + 1) / resolution : x / resolution, y / resolution, power));
-        }
-    }
-
-    // 双向斜向扫描
-    // Bidirectional oblique scanning
-    // 优化的方式同 bidirectionStdOptStrategy 函数相似
-    // The optimization method is similar to the bidirectionStdOptStrategy function
-    void diagonalStrategy() {
-        cv::Mat image;
-        cv::resize(mat, image, cv::Size(static_cast<int>(width * resolution), static_cast<int>(height * resolution)));
-        for(int k /*diagonal*/ = 0; k < image.rows + image.cols - 1 /*cond = height + width - 1*/; ++k) {
-            if((k & 1) == 0) {
-                // even
-                for(int i = std::min(k, image.rows - 1); i >= 0; --i) {
-                    int j = k - i;
-                    if(i < image.rows && j < image.cols) {
-                        internal(image, j, i,true);
-                    }
+    // 任意角度填充扫描
+    // Arbitrary-angle hatch scanning
+    // 填充线沿法线方向间隔一个像素，每条线先用 Liang–Barsky 裁剪到图像范围内，再以 16.16 定点数增量 (DDA) 按约一个像素的步长采样到行缓冲区。
+    // Hatch lines are one pixel apart along the normal, each line is clipped to the image with Liang–Barsky and then sampled into a row buffer with 16.16 fixed-point incremental (DDA) steps of about one pixel.
+    // 采样结果与行扫描一样切分为游程并直接输出线段，不旋转图像，也不逐像素生成指令。奇数线反向（蛇形）。
+    // The samples are split into runs like a row and written as segments directly, without rotating the image or emitting per-pixel commands. Odd lines run backwards (serpentine).
+    // 采样线经过像素中心，输出时沿法线退回半个像素，与行扫描的约定一致：0° 时第 n 条线位于 Y = n / resolution，与双向扫描相同。
+    // Sampling lines pass through pixel centres and are emitted half a pixel back along the normal, the raster convention: at 0° line n lies at Y = n / resolution, the same as the bidirectional scan.
+    void hatchStrategy() {
+        cv::Mat image = resized();
+        auto const cols = image.cols;
+        auto const rows = image.rows;
+
+        auto const theta = hatchAngle * std::numbers::pi / 180.0;
+        auto const dx    = std::cos(theta);  // 线的方向(Line direction)
+        auto const dy    = std::sin(theta);
+        auto const nx    = -dy;  // 法线方向(Normal direction)
+        auto const ny    = dx;
+
+        // 图像四角在法线上的投影范围决定线的数量(The projection of the image corners on the normal decides the number of lines)
+        double lo = 0, hi = 0;
+        for(auto [x, y]: std::array<std::pair<int, int>, 3> {{{cols, 0}, {0, rows}, {cols, rows}}}) {
+            lo = std::min(lo, x * nx + y * ny);
+            hi = std::max(hi, x * nx + y * ny);
+        }
+        auto const lines = static_cast<int>(std::ceil(hi - lo - 1e-9));
+
+        struct Scratch {
+            std::vector<Run> runs;
+            std::vector<std::uint8_t> samples;
+        };
+
+        generateRows<Scratch>(lines, [&](int n, Toolpath &out, Scratch &scratch) {
+            auto &[runs, samples] = scratch;
+
+            // 采样线上的点为 o + t * d，o 为线与法线的交点(Points on the sampling line are o + t * d, where o is where the line meets the normal)
+            auto const c  = lo + n + 0.5;
+            auto const ox = c * nx;
+            auto const oy = c * ny;
+
+            // Liang–Barsky：依次用 x >= 0、x <= cols、y >= 0、y <= rows 收窄 t 的范围
+            // Liang–Barsky: narrow the range of t with x >= 0, x <= cols, y >= 0 and y <= rows in turn
+            double t0 = -1e300, t1 = 1e300;
+            auto const clip = [&](double p, double q) {
+                if(std::abs(p) < 1e-12) {
+                    return q >= 0;
                 }
-            } else {
-                // odd
-                for(int j = std::min(k, image.cols - 1); j >= 0; --j) {
-                    int i = k - j;
-                    if(i < image.rows && j < image.cols) {
-                        internal(image, j, i,false);
-                    }
+                if(p < 0) {
+                    t0 = std::max(t0, q / p);
+                } else {
+                    t1 = std::min(t1, q / p);
                 }
+                return t0 < t1;
+            };
+            if(!clip(-dx, ox) || !clip(dx, cols - ox) || !clip(-dy, oy) || !clip(dy, rows - oy)) {
+                return;
             }
-        }
-    }
 
-    // 螺旋扫描 从外到里的方向
-    // Spiral scan from outside to inside direction
-    void spiralStrategy() {
-        cv::Mat image;
-        cv::resize(mat, image, cv::Size(static_cast<int>(width * resolution), static_cast<int>(height * resolution)));
+            // 约一个像素一个采样，步长取整数个等分保证最后一个采样正好落在裁剪终点
+            // About one sample per pixel, the step divides the clipped length evenly so the last sample ends exactly at the clip end
+            auto const count = std::max(1, static_cast<int>(std::lround(t1 - t0)));
+            auto const step  = (t1 - t0) / count;
 
-        int top = 0, bottom = image.rows - 1, left = 0, right = image.cols - 1;
-        while(top <= bottom && left <= right) {
-            for(int i = left; i <= right; ++i) {
-                internal(image, i, top);
+            constexpr double one = 65536.0;
+            auto fx              = static_cast<std::int64_t>(std::llround((ox + (t0 + 0.5 * step) * dx) * one));
+            auto fy              = static_cast<std::int64_t>(std::llround((oy + (t0 + 0.5 * step) * dy) * one));
+            auto const sx        = static_cast<std::int64_t>(std::llround(step * dx * one));
+            auto const sy        = static_cast<std::int64_t>(std::llround(step * dy * one));
+            samples.resize(static_cast<std::size_t>(count));
+            for(int k = 0; k < count; ++k, fx += sx, fy += sy) {
+                auto const x = std::clamp(static_cast<int>(fx >> 16), 0, cols - 1);
+                auto const y = std::clamp(static_cast<int>(fy >> 16), 0, rows - 1);
+                samples[k]   = image.ptr<std::uint8_t>(y)[x];
             }
-            ++top;
 
-            for(int i = top; i <= bottom; ++i) {
-                internal(image, right, i);
+            runs.clear();
+            extractRuns(samples, runTolerance, runs);
+            emitLineRuns(runs, n & 1, out, [&](int k) {
+                auto const t = t0 + k * step;
+                return std::pair {Toolpath::toMicro((ox - 0.5 * nx + t * dx) / resolution), Toolpath::toMicro((oy - 0.5 * ny + t * dy) / resolution)};
+            });
+        });
+    }
+
+    // 矢量轮廓：二值化（灰度 < 128 为前景）后提取全部轮廓（外轮廓和孔），按容差用 Douglas–Peucker 简化，每个轮廓输出为一条闭合的 G1 折线。
+    // Vector contours: after binarizing (gray < 128 is foreground) every contour (outlines and holes) is extracted, simplified with Douglas–Peucker within the tolerance and emitted as one closed G1 polyline.
+    // 轮廓按最近邻排序并从离当前位置最近的顶点切入以减少空移。适合切割模式 (M3) 和线稿，指令数远少于栅格扫描。
+    // Contours are ordered by nearest neighbour and entered at the vertex closest to the current position to cut rapids. Meant for cutting mode (M3) and line art, with far fewer commands than the raster modes.
+    void contourStrategy() {
+        cv::Mat image = resized();
+        cv::Mat mask(image.rows, image.cols, CV_8UC1);
+        for(int y = 0; y < image.rows; ++y) {
+            auto const *src = image.ptr<std::uint8_t>(y);
+            auto *dst       = mask.ptr<std::uint8_t>(y);
+            for(int x = 0; x < image.cols; ++x) {
+                dst[x] = src[x] < 128 ? 255 : 0;
             }
-            --right;
+        }
 
-            if(top <= bottom) {
-                for(int i = right; i >= left; --i) {
-                    internal(image, i, bottom);
+        std::vector<std::vector<cv::Point>> polygons;
+        {
+            std::vector<std::vector<cv::Point>> contours;
+            cv::findContours(mask, contours, cv::RETR_LIST, cv::CHAIN_APPROX_NONE);
+            polygons.reserve(contours.size());
+            for(auto const &contour: contours) {
+                std::vector<cv::Point> polygon;
+                cv::approxPolyDP(contour, polygon, contourTolerance * resolution, true);
+                if(!polygon.empty()) {
+                    polygons.push_back(std::move(polygon));
                 }
-                --bottom;
             }
+        }
 
-            if(left <= right) {
-                for(int i = bottom; i >= top; --i) {
-                    internal(image, left, i);
-                }
-                ++left;
+        // 轮廓点是边界像素的中心，与栅格扫描一致：像素 x 占 [x, x+1)，行 y 位于 y(Contour points are boundary pixel centres, matching the raster modes: pixel x spans [x, x+1) and row y lies at y)
+        auto const at = [&](cv::Point p) {
+            return std::pair {Toolpath::toMicro((p.x + 0.5) / resolution), Toolpath::toMicro(p.y / resolution)};
+        };
+        auto const s = power(0);
+        for(auto const [index, first]: orderContours(polygons)) {
+            auto const &polygon = polygons[index];
+            auto const [x0, y0] = at(polygon[first]);
+            command.push(Toolpath::Motion::G0, x0, y0, std::nullopt);
+            for(std::size_t k = 1; k <= polygon.size(); ++k) {
+                auto const [x, y] = at(polygon[(first + k) % polygon.size()]);
+                command.push(Toolpath::Motion::G1, x, y, s);
+            }
+            endRow();
+        }
+    }
+
+    // 闭合轮廓的最近邻顺序，返回 (轮廓下标, 切入顶点)。空间索引中存放全部顶点，每格平均约一个。
+    // Nearest-neighbour order of closed contours as (contour index, entry vertex). The spatial index holds every vertex, about one per cell.
+    static std::vector<std::pair<std::size_t, std::size_t>> orderContours(const std::vector<std::vector<cv::Point>> &polygons) {
+        std::vector<NearestNeighbour::Entry> vertices;
+        for(std::uint32_t i = 0; i < polygons.size(); ++i) {
+            for(std::uint32_t k = 0; k < polygons[i].size(); ++k) {
+                vertices.push_back({i, k, {polygons[i][k].x, polygons[i][k].y}});
             }
         }
+        NearestNeighbour index(vertices, polygons.size(), 1);
+
+        std::vector<std::pair<std::size_t, std::size_t>> order;
+        order.reserve(polygons.size());
+        NearestNeighbour::Point from {0, 0};
+        while(auto const pick = index.take(from)) {
+            order.emplace_back(pick->owner, pick->index);
+            from = pick->point;
+        }
+        return order;
     }
 
     void strategySample() {
@@ -522,10 +1610,10 @@ private:
                     command.emplace_back(G0(x * sx, y * sy, std::nullopt));
                 } else {
                     // 像素不为 255，使用 G1 移动指令，包含功率参数
-                    auto power = static_cast<int>((pixel / 255.0) * 1000.0);
-                    command.emplace_back(G1(x * sx, y * sy, power));
+                    command.emplace_back(G1(x * sx, y * sy, power(pixel)));
                 }
             }
+            endRow();
         }
     }
 
@@ -539,6 +1627,62 @@ private:
     ScanMode scanMode {ScanMode::Bidirection};   // 默认双向
     LaserMode laserMode {LaserMode::Engraving};  // 默认雕刻模式
     std::optional<int> airPump;                  // 自定义指令 气泵 用于吹走加工产生的灰尘 范围 [0,1000]
+    int feedRate {30000};                        // 移动速度 mm/min(Feed rate, mm/min)
     // add more custom cmd
-    std::vector<std::string> command;  // G 代码
+    std::vector<std::string> header;  // 头部 G 代码(Header G-code)
+    std::vector<std::string> footer;  // 尾部 G 代码(Footer G-code)
+    Toolpath command;                 // G 代码中间表示(G-code intermediate representation)
+    GCodeSink *sink {nullptr};        // 流式输出目标，为空时累积到 command(Streaming target, accumulate into command when null)
+    bool modalCompression {false};    // 模态压缩(Modal compression)
+    int runTolerance {0};             // 游程灰度容差(Run gray tolerance)
+    int threadCount {1};              // 生成线程数(Generation thread count)
+    std::unique_ptr<WorkStealingPool> pool;  // 生成线程池(Generation thread pool)
+    std::vector<Toolpath> bandSlots;         // 等待拼接的带(Bands waiting to be stitched)
+    int blockLevels {8};              // 分块扫描灰度级别数(Gray levels of block scanning)
+    ModalCompressor compressor;       // 模态状态(Modal state)
+    Toolpath compressed;              // 压缩结果缓冲(Compressed output buffer)
+    MappedFile mapped;                // 映射的 PGM/原始数据输入(Mapped PGM/raw input)
+    int mappedCols {0};               // 映射输入的宽度(Width of the mapped input)
+    int mappedRows {0};               // 映射输入的高度(Height of the mapped input)
+    std::size_t mappedOffset {0};     // 像素数据在文件中的偏移(Offset of the pixel data in the file)
+    int stripRows {256};              // 条带高度(Strip height)
+    cv::Mat strip;                    // 条带缓冲(Strip buffer)
+    int stripStart {-1};              // 条带缓冲中第一行的行号，-1 表示无效(First row held by the strip buffer, -1 when invalid)
+    Instrumentation metrics;          // 计时与统计(Timing and statistics)
+    bool travelOptimization {false};  // 空移优化(Travel optimization)
+    std::chrono::milliseconds travelBudget {1000};  // 空移优化时间预算(Time budget of the travel optimization)
+    TravelOptimizer::Report travelReport;           // 空移优化结果(Travel optimization result)
+    bool spiralInsideOut {false};                   // 螺旋从里到外(Spiral runs inside-out)
+    double hatchAngle {45.0};                       // 填充线角度 度(Hatch angle, degrees)
+    double contourTolerance {0.05};                 // 轮廓简化容差 mm(Contour simplification tolerance, mm)
+    std::optional<ArcFitter> arcFitter;             // 圆弧拟合，为空时关闭(Arc fitting, disabled when empty)
+    PowerCurve powerCurve {PowerCurve::linear()};   // 灰度到功率的传递曲线(Gray to power transfer curve)
+    Dither dither;                                  // 半色调预处理(Halftone preprocessing)
+    bool flipVertical {false};                      // 预处理垂直翻转(Preprocessing vertical flip)
+    std::optional<std::array<std::uint8_t, 256>> toneMap;  // 预处理灰度查找表(Preprocessing gray lookup table)
+    GCodeCache *cache {nullptr};                           // 结果缓存，为空时关闭(Result cache, disabled when null)
+    std::optional<std::uint64_t> cacheInput;               // 最近一次生成的主体来源(Body source of the last generation)
+    std::optional<std::uint64_t> cacheKey;                 // 最近一次查询的缓存键(Cache key of the last lookup)
+    bool cacheHit {false};                                 // 最近一次生成命中缓存(The last generation hit the cache)
+    std::string pendingFile;                               // 推迟解码的输入文件(Input file whose decoding is deferred)
+    std::optional<std::uint64_t> inputFileHash;            // 输入文件内容的哈希(Hash of the input file contents)
+
+    // 增量生成的状态(Incremental generation state)
+    struct Incremental {
+        bool enabled {false};
+        bool valid {false};                    // command 是 input 与 body 对应的主体(command is the body for input and body)
+        std::uint64_t input {0};               // 输入图像的哈希(Hash of the input image)
+        std::uint64_t body {0};                // 主体参数的哈希(Hash of the body parameters)
+        std::vector<std::uint64_t> rowHashes;  // 每行预处理后的哈希(Hash of every preprocessed row)
+        std::vector<std::size_t> rowOffsets;   // 每行在主体中的起始位置，rows + 1 项，为空时没有行索引(Start of every row in the body, rows + 1 entries, empty without a row index)
+        Toolpath previous;                     // 上一次的主体，拼接来源(The previous body, source of the splices)
+        bool tracking {false};                 // 本次生成结束后记录 input 与 body(This generation records input and body when done)
+        bool indexing {false};                 // 本次生成建立行索引(This generation builds a row index)
+        bool splice {false};                   // 本次生成复用未变的行(This generation reuses unchanged rows)
+        std::vector<std::uint64_t> nextHashes;
+        std::vector<std::size_t> sizes;        // 本次每行的指令数(Commands of every row in this generation)
+        std::vector<std::uint64_t> sourceHashes;      // 每个源行的哈希(Hash of every source row)
+        std::vector<std::uint64_t> nextSourceHashes;  // 本次输入每个源行的哈希(Hash of every source row of this input)
+        std::vector<int> dirtySource;                 // 变化的源行数的前缀和，为空时不能跳过预处理(Prefix count of changed source rows, empty when preprocessing cannot be skipped)
+    } incremental;
 };
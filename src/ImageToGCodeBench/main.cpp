@@ -0,0 +1,312 @@
+#include <algorithm>
+#include <chrono>
+#include <charconv>
+#include <cmath>
+#include <fstream>
+#include <numbers>
+#include <ostream>
+#include <print>
+#include <random>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#if defined(_WIN32)
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <sys/resource.h>
+#endif
+
+#include "ImageToGCode.h"
+
+// 扫描方式基准：在不同尺寸、不同墨量的合成图像以及 tigger.jpg 上运行 ImageToGCode 的每种扫描方式，
+// 统计生成时间、峰值内存、指令数、输出字节数和估算的加工时间，并把结果写成 JSON 以便跨版本对比。
+// Scan mode benchmark: runs every ImageToGCode scan mode on synthetic images of several sizes and ink densities and on tigger.jpg,
+// reports generation time, peak memory, command count, output bytes and estimated machine time, and writes the results as JSON to compare releases.
+//
+// ImageToGCodeBench [--json 文件(file)] [--max-size N] [--threads N] [--modal] [--arcs] [--image 路径(path)]
+
+// 只统计字节数和行数的输出缓冲，计时时使用，开销可以忽略
+// Output buffer that only counts bytes and lines, used while timing, its cost is negligible
+class CountingBuffer: public std::streambuf
+{
+public:
+    std::size_t bytes {0};
+    std::size_t lines {0};
+
+protected:
+    int_type overflow(int_type ch) override {
+        if(ch != traits_type::eof()) {
+            ++bytes;
+            lines += ch == '\n';
+        }
+        return ch;
+    }
+
+    std::streamsize xsputn(const char *s, std::streamsize n) override {
+        bytes += static_cast<std::size_t>(n);
+        lines += static_cast<std::size_t>(std::count(s, s + n, '\n'));
+        return n;
+    }
+};
+
+// 解析 G 代码并累计空移和出光距离，用于估算加工时间。支持模态（省略的 G 字和坐标沿用上一次的值）和 G2/G3 圆弧。
+// Parses the G-code and accumulates rapid and burn distance for the machine time estimate. Modal output (omitted G words and coordinates keep their last value) and G2/G3 arcs are supported.
+class MotionBuffer: public std::streambuf
+{
+public:
+    double rapid {0};     // 空移距离 mm(Rapid distance, mm)
+    double burn {0};      // 出光距离 mm(Burn distance, mm)
+    double seconds {0};   // 估算加工时间(Estimated machine time)
+    double feed {30000};  // 当前速度 毫米/每分钟(Current feed, mm/min)
+
+protected:
+    int_type overflow(int_type ch) override {
+        if(ch != traits_type::eof()) {
+            put(static_cast<char>(ch));
+        }
+        return ch;
+    }
+
+    std::streamsize xsputn(const char *s, std::streamsize n) override {
+        for(std::streamsize i = 0; i < n; ++i) {
+            put(s[i]);
+        }
+        return n;
+    }
+
+private:
+    void put(char c) {
+        if(c != '\n') {
+            if(line.size() < 256) {
+                line.push_back(c);
+            }
+            return;
+        }
+
+        double x = this->x, y = this->y, i = 0, j = 0;
+        for(std::size_t i = 0; i < line.size();) {
+            auto const word = line[i++];
+            double value    = 0;
+            auto const [end, ec] = std::from_chars(line.data() + i, line.data() + line.size(), value);
+            if(ec != std::errc {}) {
+                continue;
+            }
+            i = static_cast<std::size_t>(end - line.data());
+            switch(word) {
+                case 'G':
+                    if(value == 0 || value == 1 || value == 2 || value == 3) {
+                        motion = static_cast<int>(value);
+                    }
+                    break;
+                case 'X': x = value; break;
+                case 'Y': y = value; break;
+                case 'I': i = value; break;
+                case 'J': j = value; break;
+                case 'F': feed = value; break;
+                default: break;
+            }
+        }
+        line.clear();
+
+        auto distance = std::hypot(x - this->x, y - this->y);
+        if(motion >= 2 && distance > 0) {
+            // 圆弧长度：按方向从起点角转到终点角(Arc length: turn from the start angle to the end angle in the direction of motion)
+            auto const cx = this->x + i, cy = this->y + j;
+            auto sweep    = std::atan2(y - cy, x - cx) - std::atan2(this->y - cy, this->x - cx);
+            sweep         = motion == 3 ? sweep : -sweep;
+            while(sweep <= 0) {
+                sweep += 2 * std::numbers::pi;
+            }
+            distance = sweep * std::hypot(i, j);
+        }
+        (motion == 0 ? rapid : burn) += distance;
+        seconds += distance / feed * 60.0;
+        this->x = x;
+        this->y = y;
+    }
+
+private:
+    std::string line;
+    double x {0}, y {0};
+    int motion {0};
+};
+
+// 峰值常驻内存 KiB。Linux 下每个用例开始前清零，其他平台为进程启动以来的峰值。
+// Peak resident memory in KiB. On Linux it is reset before every case, on other platforms it is the peak since process start.
+static void resetPeakMemory() {
+#if defined(__linux__)
+    std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+static std::size_t peakMemoryKiB() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters {};
+    ::GetProcessMemoryInfo(::GetCurrentProcess(), &counters, sizeof(counters));
+    return counters.PeakWorkingSetSize / 1024;
+#elif defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    for(std::string line; std::getline(status, line);) {
+        if(line.starts_with("VmHWM:")) {
+            return std::stoul(line.substr(6));
+        }
+    }
+    return 0;
+#else
+    rusage usage {};
+    ::getrusage(RUSAGE_SELF, &usage);
+    return static_cast<std::size_t>(usage.ru_maxrss) / 1024;  // macOS 以字节为单位(bytes on macOS)
+#endif
+}
+
+// 合成图像，固定随机种子保证每次运行相同
+// Synthetic images with a fixed random seed so every run is identical
+static cv::Mat makeImage(const std::string &density, int size) {
+    cv::Mat image(size, size, CV_8UC1);
+    std::mt19937 rng(size);
+    for(int y = 0; y < size; ++y) {
+        auto *row = image.ptr<std::uint8_t>(y);
+        for(int x = 0; x < size; ++x) {
+            if(density == "sparse") {
+                // 约 4% 的黑色小方块(About 4% small black squares)
+                row[x] = (x / 16 % 5 == 0 && y / 16 % 5 == 0) ? 0 : 255;
+            } else if(density == "dense") {
+                // 大部分出光，少量空白(Mostly burning with a few blanks)
+                row[x] = (x / 32 + y / 32) % 4 == 0 ? 255 : static_cast<std::uint8_t>((x / 32 * 37 + y / 32 * 11) % 200);
+            } else if(density == "noise") {
+                // 一半空白，一半随机灰度(Half blank, half random gray)
+                auto const r = rng();
+                row[x]       = (r & 1) ? 255 : static_cast<std::uint8_t>((r >> 8) % 255);
+            } else {
+                // 水平渐变(Horizontal gradient)
+                row[x] = static_cast<std::uint8_t>(static_cast<long long>(x) * 255 / std::max(1, size - 1));
+            }
+        }
+    }
+    return image;
+}
+
+struct Result {
+    std::string image;
+    int cols;
+    int rows;
+    std::string mode;
+    double seconds;
+    std::size_t peakKiB;
+    std::size_t lines;
+    std::size_t bytes;
+    double rapid;
+    double burn;
+    double machineSeconds;
+};
+
+int main(int argc, char *argv[]) {
+    std::string jsonPath  = "ImageToGCodeBench.json";
+    std::string imagePath = "image/tigger.jpg";
+    int maxSize           = 16384;
+    int threads           = 1;
+    bool modal            = false;
+    bool arcs             = false;
+    for(int i = 1; i < argc; ++i) {
+        std::string const arg = argv[i];
+        if(arg == "--json" && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if(arg == "--image" && i + 1 < argc) {
+            imagePath = argv[++i];
+        } else if(arg == "--max-size" && i + 1 < argc) {
+            maxSize = std::stoi(argv[++i]);
+        } else if(arg == "--threads" && i + 1 < argc) {
+            threads = std::stoi(argv[++i]);
+        } else if(arg == "--modal") {
+            modal = true;
+        } else if(arg == "--arcs") {
+            arcs = true;
+        } else {
+            std::println("usage: {} [--json file] [--max-size N] [--threads N] [--modal] [--arcs] [--image path]", argv[0]);
+            return 1;
+        }
+    }
+
+    using Mode = ImageToGCode::ScanMode;
+    std::pair<const char *, Mode> const modes[] {
+        {"Unidirection", Mode::Unidirection},
+        {"Bidirection", Mode::Bidirection},
+        {"Diagonal", Mode::Diagonal},
+        {"Spiral", Mode::Spiral},
+        {"Block", Mode::Block},
+        {"BidirectionStd", Mode::BidirectionStd},
+        {"DiagonalUnidirection", Mode::DiagonalUnidirection},
+        {"Hatch", Mode::Hatch},
+        {"Contour", Mode::Contour},
+    };
+
+    std::vector<std::pair<std::string, cv::Mat>> images;
+    std::vector<Result> results;
+    std::println("{:<24} {:>12} {:>20} {:>10} {:>10} {:>12} {:>14} {:>12}", "image", "size", "mode", "time s", "peak MiB", "lines", "bytes", "machine s");
+
+    auto const run = [&](const std::string &name, const cv::Mat &image) {
+        for(auto const &[modeName, mode]: modes) {
+            // 目标尺寸与源图像相同，按 10 线/毫米输出，不做缩放
+            // The target size equals the source size at 10 lines/mm, so nothing is resized
+            ImageToGCode generator;
+            generator.setInputImage(image)
+                .setOutputTragetSize((image.cols + 0.5) / 10.0, (image.rows + 0.5) / 10.0, 10)
+                .setScanMode(mode)
+                .setThreadCount(threads)
+                .setModalCompression(modal)
+                .setArcFitting(arcs);
+
+            // 计时的一遍只计数；第二遍解析输出估算加工时间
+            // The timed pass only counts; a second pass parses the output to estimate machine time
+            CountingBuffer counting;
+            std::ostream countingStream(&counting);
+            resetPeakMemory();
+            auto const begin = std::chrono::steady_clock::now();
+            generator.streamGCode(countingStream);
+            auto const end   = std::chrono::steady_clock::now();
+            auto const peak  = peakMemoryKiB();
+
+            MotionBuffer motion;
+            std::ostream motionStream(&motion);
+            generator.streamGCode(motionStream);
+
+            Result result {name, image.cols, image.rows, modeName, std::chrono::duration<double>(end - begin).count(), peak, counting.lines, counting.bytes, motion.rapid, motion.burn, motion.seconds};
+            std::println("{:<24} {:>5}x{:<6} {:>20} {:>10.3f} {:>10.1f} {:>12} {:>14} {:>12.0f}", result.image, result.cols, result.rows, result.mode, result.seconds, result.peakKiB / 1024.0, result.lines, result.bytes,
+                         result.machineSeconds);
+            results.push_back(std::move(result));
+        }
+    };
+
+    for(int size = 256; size <= maxSize; size *= 4) {
+        for(auto const *density: {"sparse", "dense", "noise", "gradient"}) {
+            run(density, makeImage(density, size));
+        }
+    }
+
+    if(cv::Mat tigger = cv::imread(imagePath, cv::IMREAD_GRAYSCALE); !tigger.empty()) {
+        run("tigger", tigger);
+    } else {
+        std::println("can not read {}, skipped", imagePath);
+    }
+
+    std::ofstream json(jsonPath, std::ios_base::out | std::ios_base::trunc);
+    if(!json.is_open()) {
+        std::println("can not write {}", jsonPath);
+        return 1;
+    }
+    std::println(json, "{{\"threads\": {}, \"modal\": {}, \"arcs\": {}, \"results\": [", threads, modal, arcs);
+    for(std::size_t i = 0; i < results.size(); ++i) {
+        auto const &r = results[i];
+        std::println(json,
+                     "  {{\"image\": \"{}\", \"cols\": {}, \"rows\": {}, \"mode\": \"{}\", \"seconds\": {:.6f}, \"peakKiB\": {}, \"lines\": {}, \"bytes\": {}, \"rapidMm\": {:.3f}, \"burnMm\": {:.3f}, \"machineSeconds\": {:.3f}}}{}",
+                     r.image, r.cols, r.rows, r.mode, r.seconds, r.peakKiB, r.lines, r.bytes, r.rapid, r.burn, r.machineSeconds, i + 1 < results.size() ? "," : "");
+    }
+    std::println(json, "]}}");
+    return 0;
+}
@@ -0,0 +1,700 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <numbers>
+#include <print>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ArcFitter.hpp"
+#include "BinaryToolpath.hpp"
+#include "Common.hpp"
+#include "Dither.hpp"
+#include "GCodeSink.hpp"
+#include "ImageToGCode.h"
+#include "PowerCurve.hpp"
+#include "RowScanner.hpp"
+#include "RunExtractor.hpp"
+#include "Toolpath.hpp"
+
+// 回归测试：每个用例返回 true 表示通过，任一失败时进程返回 1，由 ctest 运行
+// Regression tests: every case returns true on success, the process returns 1 if any fails, run by ctest
+
+static bool check(bool ok, std::string_view what) {
+    if(!ok) {
+        std::println("  failed: {}", what);
+    }
+    return ok;
+}
+
+// float 编码器与 std::format("{:.3f}") 相同，保留 -0.000；微米编码器在 (-0.0005, 0) 内写出 0.000，其余负数两者相同
+// The float encoder matches std::format("{:.3f}") and keeps -0.000; the micrometre encoder prints 0.000 in (-0.0005, 0) and agrees on every other negative value
+static bool testNegativeZero() {
+    char line[GCodeEncoder::kMaxLine];
+    auto const fixed = [&](float v) { return std::string(line, GCodeEncoder::writeFixed3(line, v)); };
+    auto const micro = [&](float v) {
+        Toolpath path;
+        path.emplace_back(G0 {v, std::nullopt, std::nullopt});
+        return std::string(line, path.encode(line, 0));
+    };
+
+    bool ok = true;
+    ok &= check(fixed(-0.0003f) == "-0.000", "float encoder writes -0.000");
+    ok &= check(micro(-0.0003f) == "G0 X0.000", "micrometre encoder writes 0.000");
+    ok &= check(micro(-0.0f) == "G0 X0.000", "micrometre encoder drops the sign of -0");
+    ok &= check(micro(-0.0006f) == "G0 X-0.001" && fixed(-0.0006f) == "-0.001", "both write -0.001");
+    ok &= check(micro(-12.345f) == "G0 X-12.345" && fixed(-12.345f) == "-12.345", "both write -12.345");
+    return ok;
+}
+
+// 标量、SSE2、AVX2 的行扫描结果相同：边界落在 16/32 字节通道边缘附近、奇数行宽和不同的起点与对齐
+// Scalar, SSE2 and AVX2 row scanning agree: boundaries near 16/32-byte lane edges, odd row widths and different starts and alignments
+static bool testRowScannerIsas() {
+    std::vector<RowScanner::FindOutside> impls;
+    for(auto const isa: {RowScanner::Isa::SSE2, RowScanner::Isa::AVX2}) {
+        if(RowScanner::supported(isa)) {
+            impls.push_back(RowScanner::get(isa));
+        }
+    }
+    auto const scalar = RowScanner::get(RowScanner::Isa::Scalar);
+
+    std::vector<std::uint8_t> buffer(256);
+    int mismatches = 0;
+    for(int width: {1, 7, 15, 16, 17, 31, 32, 33, 47, 48, 63, 64, 65, 95, 97, 131}) {
+        for(int align = 0; align < 4; ++align) {
+            auto *row = buffer.data() + align;
+            for(int boundary = 0; boundary <= width; ++boundary) {
+                std::fill(row, row + width, std::uint8_t {100});
+                if(boundary < width) {
+                    row[boundary] = 200;
+                }
+                for(int start: {0, 1, std::max(0, boundary - 1), boundary, std::min(width, boundary + 1)}) {
+                    for(auto const [lo, hi]: {std::pair<std::uint8_t, std::uint8_t> {90, 110}, {100, 100}, {0, 254}, {201, 255}}) {
+                        auto const expected = scalar(row, start, width, lo, hi);
+                        for(auto const impl: impls) {
+                            mismatches += impl(row, start, width, lo, hi) != expected;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return check(mismatches == 0, std::format("{} mismatches against the scalar scanner over {} SIMD implementations", mismatches, impls.size()));
+}
+
+// 游程切分：容差内合并并取平均，单个像素，整行空白，游程延伸到行尾
+// Run extraction: merging and averaging within tolerance, a single pixel, an all-blank row and a run that touches the row end
+static bool testRunExtraction() {
+    auto const extract = [](std::vector<std::uint8_t> const &pixels, int tolerance) {
+        std::vector<Run> runs;
+        extractRuns(pixels, tolerance, runs);
+        return runs;
+    };
+    auto const same = [](std::vector<Run> const &a, std::vector<Run> const &b) {
+        return std::ranges::equal(a, b, [](const Run &x, const Run &y) { return x.start == y.start && x.end == y.end && x.value == y.value; });
+    };
+
+    bool ok = true;
+    ok &= check(same(extract({10, 12, 15, 30, 255}, 5), {{0, 3, 12}, {3, 4, 30}, {4, 5, 255}}), "tolerance 5 merges 10 12 15 at their mean");
+    ok &= check(same(extract({50, 50, 51, 254}, 0), {{0, 2, 50}, {2, 3, 51}, {3, 4, 254}}), "tolerance 0 only merges equal gray");
+    ok &= check(same(extract({250, 254, 255}, 10), {{0, 2, 252}, {2, 3, 255}}), "blank never joins a run within tolerance");
+    ok &= check(same(extract({77}, 0), {{0, 1, 77}}) && same(extract({255}, 0), {{0, 1, 255}}), "single pixel");
+    ok &= check(same(extract(std::vector<std::uint8_t>(100, 255), 3), {{0, 100, 255}}), "all-blank row is one run");
+
+    std::vector<std::uint8_t> tail(100, 255);
+    std::fill(tail.begin() + 40, tail.end(), 9);
+    ok &= check(same(extract(tail, 0), {{0, 40, 255}, {40, 100, 9}}), "run touching the row end");
+    ok &= check(extract({}, 0).empty(), "empty row has no runs");
+    return ok;
+}
+
+static std::string readFile(const std::filesystem::path &path) {
+    std::ifstream file(path, std::ios_base::binary);
+    return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+// 测试用的临时文件路径(Path of a temporary file for a test)
+static std::filesystem::path tempPath(std::string_view name) {
+    return std::filesystem::temp_directory_path() / std::format("ImageToGCodeTest-{}", name);
+}
+
+// 随机灰度图像，约四分之一为空白(Random gray image, about a quarter of it blank)
+static cv::Mat randomImage(int rows, int cols, unsigned seed) {
+    std::mt19937 rng(seed);
+    cv::Mat mat(rows, cols, CV_8UC1);
+    for(int y = 0; y < rows; ++y) {
+        for(int x = 0; x < cols; ++x) {
+            mat.at<std::uint8_t>(y, x) = rng() % 4 == 0 ? 255 : static_cast<std::uint8_t>(rng() % 255);
+        }
+    }
+    return mat;
+}
+
+// 伽马曲线与 std::pow 相差不超过 1；分段曲线在控制点之间四舍五入插值，两端保持端点功率；clamp 只作用于非空白灰度，与 sMax 无关
+// The gamma curve is within 1 of std::pow; the piecewise curve interpolates with rounding between control points and holds the end powers; clamp only touches non-blank gray levels whatever sMax is
+static bool testPowerCurves() {
+    bool ok = true;
+    for(auto const g: {0.45, 1.0, 2.2}) {
+        auto const curve = PowerCurve::gamma(g, 800);
+        bool close       = curve(255) == 0;
+        for(int gray = 0; gray < 255; ++gray) {
+            auto const expected = static_cast<int>(std::pow(1.0 - gray / 255.0, g) * 800);
+            close &= std::abs(curve(static_cast<std::uint8_t>(gray)) - expected) <= 1 && (gray == 0 || curve(static_cast<std::uint8_t>(gray)) <= curve(static_cast<std::uint8_t>(gray - 1)));
+        }
+        ok &= check(close, std::format("gamma {} follows std::pow and never increases", g));
+    }
+
+    auto const piecewise = PowerCurve::piecewise({{10, 800}, {110, 300}, {210, 100}, {214, 101}});
+    ok &= check(piecewise(0) == 800 && piecewise(10) == 800, "piecewise holds the first point below it");
+    ok &= check(piecewise(60) == 550 && piecewise(110) == 300 && piecewise(160) == 200 && piecewise(11) == 795, "piecewise interpolates between points");
+    ok &= check(piecewise(212) == 101 && piecewise(211) == 100, "piecewise rounds half away from zero");
+    ok &= check(piecewise(254) == 101 && piecewise(255) == 0, "piecewise holds the last point and keeps blank at 0");
+
+    auto const linear = PowerCurve::linear(255);
+    auto clamped      = linear;
+    clamped.clamp(20, 200);
+    ok &= check(linear(0) == 255 && linear(254) <= 1, "linear reaches sMax with a custom sMax");
+    ok &= check(clamped(0) == 200 && clamped(254) == 20 && clamped(255) == 0, "clamp maps the ends to max and min and keeps blank at 0");
+    ok &= check(clamped(100) == linear(100), "clamp keeps powers inside the range");
+    return ok;
+}
+
+// 误差扩散的每种核在 1 个和多个线程下结果逐字节相同，多线程分条带调用也与整幅相同；宽度跨过多个流水线分块
+// Every error-diffusion kernel gives identical bytes with one and with several threads, also when the threaded one is called strip by strip; the width spans several pipeline chunks
+static bool testDitherThreadInvariance() {
+    constexpr int rows = 157, cols = 301;
+    std::mt19937 rng(6);
+    std::vector<std::uint8_t> source(rows * cols);
+    std::ranges::generate(source, [&] { return static_cast<std::uint8_t>(rng() % 256); });
+
+    auto const run = [&](Dither::Method method, int threads, int stripRows) {
+        auto pixels = source;
+        Dither dither;
+        dither.setMethod(method);
+        dither.setThreadCount(threads);
+        dither.reset();
+        for(int y = 0; y < rows; y += stripRows) {
+            dither.apply(pixels.data() + y * cols, cols, std::min(stripRows, rows - y), cols);
+        }
+        return pixels;
+    };
+
+    bool ok = true;
+    for(auto const method: {Dither::Method::FloydSteinberg, Dither::Method::Jarvis, Dither::Method::Stucki, Dither::Method::Atkinson}) {
+        auto const serial = run(method, 1, rows);
+        ok &= check(std::ranges::all_of(serial, [](auto v) { return v == 0 || v == 255; }), std::format("method {} is binary", static_cast<int>(method)));
+        for(auto const threads: {2, 3, 8}) {
+            ok &= check(run(method, threads, rows) == serial, std::format("method {} with {} threads", static_cast<int>(method), threads));
+            ok &= check(run(method, threads, 13) == serial, std::format("method {} with {} threads in strips", static_cast<int>(method), threads));
+        }
+    }
+    return ok;
+}
+
+// 圆弧拟合：采样的圆弧逆时针为 G3、顺时针为 G2，圆心 I/J 在容差内，最后一段圆弧正好停在最后一个点上；直线、折线和 G0 原样保留，圆弧不跨过 G0
+// Arc fitting: a sampled counterclockwise arc becomes G3 and a clockwise one G2, the I/J centre is within the tolerance and the last arc ends exactly on the last point; straight runs, zigzags and G0 pass through unchanged and no arc spans a G0
+static bool testArcFitter() {
+    constexpr double tolerance = 10.0;
+    constexpr std::int32_t cx  = 50000, cy = 40000, radius = 20000;
+    auto const onCircle = [&](double angle) {
+        return std::pair {static_cast<std::int32_t>(std::lround(cx + radius * std::cos(angle))), static_cast<std::int32_t>(std::lround(cy + radius * std::sin(angle)))};
+    };
+    // 从 from 到 to 的 points + 1 个采样点，第一个点用 G0 到达(points + 1 samples from from to to, the first one reached with a G0)
+    auto const arc = [&](Toolpath &path, double from, double to, int points) {
+        auto const [x0, y0] = onCircle(from);
+        path.push(Toolpath::Motion::G0, x0, y0, std::nullopt);
+        for(int k = 1; k <= points; ++k) {
+            auto const [x, y] = onCircle(from + (to - from) * k / points);
+            path.push(Toolpath::Motion::G1, x, y, k == 1 ? std::optional(500) : std::nullopt);
+        }
+        return onCircle(to);
+    };
+    // 每段圆弧的圆心都在真实圆心的容差内，并且最后停在 end(Every arc centre is within the tolerance of the true centre and the path ends at end)
+    auto const arcsAround = [&](const Toolpath &path, Toolpath::Motion motion, std::pair<std::int32_t, std::int32_t> end) {
+        std::int32_t x = 0, y = 0;
+        bool ok        = path.size() >= 2 && path[0].motion() == Toolpath::Motion::G0;
+        for(std::size_t k = 0; k < path.size() && ok; ++k) {
+            auto const c = path[k];
+            if(k > 0) {
+                ok = c.motion() == motion && std::hypot(x + c.i - cx, y + c.j - cy) <= tolerance + 1;
+            }
+            x = c.hasX() ? c.x : x;
+            y = c.hasY() ? c.y : y;
+        }
+        return ok && std::pair {x, y} == end;
+    };
+
+    bool ok = true;
+    {
+        Toolpath path;
+        auto const end = arc(path, 0, std::numbers::pi / 2, 40);
+        ArcFitter fitter(tolerance);
+        auto const report = fitter.fit(path);
+        ok &= check(report.arcs >= 1 && path.size() < 41 && arcsAround(path, Toolpath::Motion::G3, end), "counterclockwise quarter becomes G3");
+    }
+    {
+        Toolpath path;
+        auto const end = arc(path, std::numbers::pi, std::numbers::pi / 4, 50);
+        ArcFitter fitter(tolerance);
+        fitter.fit(path);
+        ok &= check(arcsAround(path, Toolpath::Motion::G2, end), "clockwise arc becomes G2");
+    }
+
+    auto const same = [](const Toolpath &a, const Toolpath &b) {
+        if(a.size() != b.size()) {
+            return false;
+        }
+        for(std::size_t k = 0; k < a.size(); ++k) {
+            auto const x = a[k], y = b[k];
+            if(x.op != y.op || x.x != y.x || x.y != y.y || x.s != y.s) {
+                return false;
+            }
+        }
+        return true;
+    };
+    {
+        // 直线、大幅折线和 G0 空移(A straight run, a wide zigzag and G0 rapids)
+        Toolpath path;
+        path.push(Toolpath::Motion::G0, 1000, 1000, std::nullopt);
+        for(int k = 1; k <= 8; ++k) {
+            path.push(Toolpath::Motion::G1, 1000 + k * 700, std::nullopt, 300);
+        }
+        path.push(Toolpath::Motion::G0, 9000, 5000, std::nullopt);
+        for(int k = 1; k <= 8; ++k) {
+            path.push(Toolpath::Motion::G1, 9000 + k * 500, 5000 + (k & 1) * 2000, 600);
+        }
+        auto const original = path;
+        ArcFitter fitter(tolerance);
+        ok &= check(fitter.fit(path).arcs == 0 && same(path, original), "straight runs and zigzags are unchanged");
+    }
+    {
+        // 同一个圆上的两段被 G0 隔开，每段单独拟合，G0 保持原位(Two pieces of one circle separated by a G0 are fitted separately and the G0 stays in place)
+        Toolpath path;
+        auto const middle = arc(path, 0, std::numbers::pi / 3, 30);
+        arc(path, std::numbers::pi / 3, 2 * std::numbers::pi / 3, 30);
+        ArcFitter fitter(tolerance);
+        fitter.fit(path);
+        std::vector<std::size_t> rapids;
+        std::int32_t x = 0, y = 0;
+        for(std::size_t k = 0; k < path.size(); ++k) {
+            auto const c = path[k];
+            if(c.motion() == Toolpath::Motion::G0) {
+                rapids.push_back(k);
+                ok &= check(k == 0 || std::pair {x, y} == middle, "the arc before the G0 ends on its last point");
+            }
+            x = c.hasX() ? c.x : x;
+            y = c.hasY() ? c.y : y;
+        }
+        ok &= check(rapids.size() == 2 && path[rapids[1]].x == middle.first && path[rapids[1]].y == middle.second, "the G0 between the pieces is kept");
+    }
+    return ok;
+}
+
+// 缩放为面积平均：3x3 缩小到 1x1 取 9 个像素的平均 (0 + 90 + 240) / 3 = 110，cv::resize 的双线性插值会得到中心像素 90
+// Resampling is area averaging: 3x3 shrunk to 1x1 is the mean of the 9 pixels (0 + 90 + 240) / 3 = 110, bilinear cv::resize would give the centre pixel 90
+static bool testAreaResampling() {
+    cv::Mat mat(3, 3, CV_8UC1);
+    for(int y = 0; y < 3; ++y) {
+        mat.at<std::uint8_t>(y, 0) = 0;
+        mat.at<std::uint8_t>(y, 1) = 90;
+        mat.at<std::uint8_t>(y, 2) = 240;
+    }
+    ImageToGCode ins;
+    ins.setInputImage(mat).setOutputTragetSize(0.1, 0.1, 10).builder();
+    auto const &path = ins.getToolpath();
+    return check(path.size() == 2 && path[1].motion() == Toolpath::Motion::G1 && path[1].s == PowerCurve::linear()(110), "1x1 pixel burns at the power of gray 110");
+}
+
+// 分条处理映射的 PGM 文件与整幅处理内存中的图像，输出逐字节相同
+// Strip-wise processing of a mapped PGM file and whole-image processing of the in-memory image give identical bytes
+static bool testTiledMatchesInMemory() {
+    auto const mat   = randomImage(301, 257, 1);
+    auto const image = tempPath("tiled.pgm");
+    {
+        std::ofstream file(image, std::ios_base::binary);
+        file << std::format("P5\n{} {}\n255\n", mat.cols, mat.rows);
+        for(int y = 0; y < mat.rows; ++y) {
+            file.write(reinterpret_cast<const char *>(mat.ptr<std::uint8_t>(y)), mat.cols);
+        }
+    }
+
+    bool ok = true;
+    for(auto const mode: {ImageToGCode::ScanMode::Unidirection, ImageToGCode::ScanMode::Bidirection, ImageToGCode::ScanMode::BidirectionStd, ImageToGCode::ScanMode::Block}) {
+        ImageToGCode tiled, whole;
+        tiled.setInputFile(image.string()).setStripRows(16).setScanMode(mode).setFlipVertical(true).setOutputTragetSize(19.3, 23.9, 10).builder().exportGCode(tempPath("tiled.nc").string());
+        whole.setInputImage(mat).setScanMode(mode).setFlipVertical(true).setOutputTragetSize(19.3, 23.9, 10).builder().exportGCode(tempPath("whole.nc").string());
+        ok &= check(readFile(tempPath("tiled.nc")) == readFile(tempPath("whole.nc")), std::format("scan mode {}", static_cast<int>(mode)));
+    }
+    std::filesystem::remove(image);
+    std::filesystem::remove(tempPath("tiled.nc"));
+    std::filesystem::remove(tempPath("whole.nc"));
+    return ok;
+}
+
+// 每种扫描方式在 1 个和多个线程下输出逐字节相同；图像足够高，使多线程时分多批提交带，预处理也分给多个线程
+// Every scan mode gives identical bytes with one and with several threads; the image is tall enough that the bands are submitted in several batches and the preprocessing is split across threads
+static bool testThreadCountInvariance() {
+    using enum ImageToGCode::ScanMode;
+    auto const mat    = randomImage(700, 49, 4);
+    auto const serial = tempPath("serial.nc");
+    auto const pooled = tempPath("pooled.nc");
+
+    bool ok = true;
+    for(auto const mode: {Unidirection, Bidirection, Diagonal, Spiral, Block, BidirectionStd, DiagonalUnidirection, Hatch, Contour}) {
+        for(auto const dither: {Dither::Method::None, Dither::Method::FloydSteinberg}) {
+            ImageToGCode one, many;
+            one.setInputImage(mat).setThreadCount(1).setScanMode(mode).setDither(dither).setOutputTragetSize(9.7, 140, 10).builder().exportGCode(serial.string());
+            many.setInputImage(mat).setThreadCount(3).setScanMode(mode).setDither(dither).setOutputTragetSize(9.7, 140, 10);
+            // 同一个实例生成两次，第二次复用线程池(The same instance builds twice, the second time reuses the thread pool)
+            many.builder().builder().exportGCode(pooled.string());
+            ok &= check(readFile(serial) == readFile(pooled), std::format("scan mode {} dither {}", static_cast<int>(mode), static_cast<int>(dither)));
+        }
+    }
+    std::filesystem::remove(serial);
+    std::filesystem::remove(pooled);
+    return ok;
+}
+
+// 0° 填充线与双向扫描的几何相同：补全省略的坐标后每条指令的运动、终点和功率都一致（允许 1 微米的舍入差）
+// A 0° hatch has the geometry of the bidirectional scan: once omitted coordinates are filled in, every command has the same motion, end point and power (within 1 micrometre of rounding)
+static bool testHatchMatchesBidirection() {
+    struct Move {
+        Toolpath::Motion motion;
+        std::int32_t x, y;
+        int s;
+    };
+    auto const moves = [](const Toolpath &path) {
+        std::vector<Move> result;
+        std::int32_t x = 0, y = 0;
+        for(std::size_t k = 0; k < path.size(); ++k) {
+            auto const c = path[k];
+            x            = c.hasX() ? c.x : x;
+            y            = c.hasY() ? c.y : y;
+            result.push_back({c.motion(), x, y, c.hasS() ? c.s : -1});
+        }
+        return result;
+    };
+
+    auto const mat = randomImage(83, 71, 5);
+    ImageToGCode hatch, rows;
+    hatch.setInputImage(mat).setScanMode(ImageToGCode::ScanMode::Hatch).setHatchAngle(0).setOutputTragetSize(8.3, 6.1, 10).builder();
+    rows.setInputImage(mat).setScanMode(ImageToGCode::ScanMode::Bidirection).setOutputTragetSize(8.3, 6.1, 10).builder();
+    auto const a = moves(hatch.getToolpath());
+    auto const b = moves(rows.getToolpath());
+    if(!check(a.size() == b.size() && !a.empty(), "same number of commands")) {
+        return false;
+    }
+    bool ok = true;
+    for(std::size_t k = 0; k < a.size() && ok; ++k) {
+        ok = check(a[k].motion == b[k].motion && std::abs(a[k].x - b[k].x) <= 1 && a[k].y == b[k].y && a[k].s == b[k].s, std::format("command {}", k));
+    }
+    return ok;
+}
+
+// 轮廓模式为每个前景区域输出一条闭合折线：以 G0 切入，G1 回到切入点，每个区域只走一次
+// Contour mode emits one closed polyline per foreground region: entered with a G0, back at the entry point with a G1, every region visited once
+static bool testContourClosesPolygons() {
+    struct Box {
+        int x0, y0, x1, y1;  // 像素，包含(pixels, inclusive)
+    };
+    std::array const boxes {Box {2, 3, 10, 8}, Box {30, 5, 50, 12}, Box {5, 25, 15, 35}, Box {40, 28, 55, 36}, Box {20, 15, 24, 18}};
+    cv::Mat mat(40, 60, CV_8UC1, 255);
+    for(auto const &b: boxes) {
+        for(int y = b.y0; y <= b.y1; ++y) {
+            for(int x = b.x0; x <= b.x1; ++x) {
+                mat.at<std::uint8_t>(y, x) = 0;
+            }
+        }
+    }
+
+    ImageToGCode ins;
+    ins.setInputImage(mat).setScanMode(ImageToGCode::ScanMode::Contour).setOutputTragetSize(6, 4, 10).builder();
+    auto const &path = ins.getToolpath();
+
+    // 按 G0 切分为折线，坐标换回像素：点位于像素中心的 X 和行的 Y(Split into polylines at every G0 and map back to pixels: points sit at the pixel centre in X and at the row in Y)
+    std::vector<std::vector<std::pair<int, int>>> polylines;
+    std::int32_t x = 0, y = 0;
+    for(std::size_t k = 0; k < path.size(); ++k) {
+        auto const c = path[k];
+        x            = c.hasX() ? c.x : x;
+        y            = c.hasY() ? c.y : y;
+        if(c.motion() == Toolpath::Motion::G0) {
+            polylines.emplace_back();
+        } else if(polylines.empty() || c.motion() != Toolpath::Motion::G1) {
+            return check(false, "only G0 and G1, starting with a G0");
+        }
+        polylines.back().emplace_back(static_cast<int>(std::lround(x / 100.0 - 0.5)), static_cast<int>(std::lround(y / 100.0)));
+    }
+
+    bool ok = check(polylines.size() == boxes.size(), "one polyline per region");
+    std::array<int, boxes.size()> visits {};
+    for(auto const &polyline: polylines) {
+        ok &= check(polyline.size() >= 3 && polyline.front() == polyline.back(), "polyline is closed");
+        for(std::size_t b = 0; b < boxes.size(); ++b) {
+            auto const &box = boxes[b];
+            visits[b] += std::ranges::all_of(polyline, [&](auto p) { return p.first >= box.x0 && p.first <= box.x1 && p.second >= box.y0 && p.second <= box.y1; });
+        }
+    }
+    ok &= check(std::ranges::all_of(visits, [](int v) { return v == 1; }), "every region is visited exactly once");
+    return ok;
+}
+
+// 增量生成：只改头部时复用上次的主体，不再扫描；改了像素后重新生成的程序与全新生成的逐字节相同。覆盖单向/双向、有无抖动和多线程
+// Incremental generation: a header-only change reuses the previous body without scanning; after a pixel edit the rebuilt program is byte-identical to a fresh build. Covers one-way/bidirectional, with and without dithering and several threads
+static bool testIncrementalBuild() {
+    auto const output  = tempPath("incremental.nc");
+    auto const fresh   = tempPath("fresh.nc");
+    auto const scanned = [](const ImageToGCode &ins) {
+        auto const &phases = ins.getInstrumentation().getPhases();
+        return std::ranges::find(phases, std::string_view("strategy"), &Instrumentation::Phase::name) != phases.end();
+    };
+
+    bool ok = true;
+    for(auto const mode: {ImageToGCode::ScanMode::Unidirection, ImageToGCode::ScanMode::Bidirection}) {
+        for(auto const dither: {Dither::Method::None, Dither::Method::FloydSteinberg}) {
+            for(auto const threads: {1, 3}) {
+                auto const what  = std::format("scan mode {} dither {} threads {}", static_cast<int>(mode), static_cast<int>(dither), threads);
+                auto const setup = [&](ImageToGCode &ins) -> ImageToGCode & {
+                    return ins.setScanMode(mode).setDither(dither).setThreadCount(threads).setStripRows(32).setOutputTragetSize(15, 18, 10);
+                };
+                auto const matches = [&](const cv::Mat &mat, int feedRate) {
+                    ImageToGCode other;
+                    setup(other).setInputImage(mat).setFeedRate(feedRate).builder().exportGCode(fresh.string());
+                    return readFile(output) == readFile(fresh);
+                };
+
+                auto const original = randomImage(180, 150, 7);
+                ImageToGCode ins;
+                setup(ins).setIncrementalBuild(true).setInstrumentation(true).setInputImage(original).builder();
+
+                ins.setFeedRate(12345).builder().exportGCode(output.string());
+                ok &= check(!scanned(ins) && matches(original, 12345), what + ": header change reuses the body");
+
+                // 新的图像对象，原图像保持不变(A new image object, the original stays untouched)
+                auto edited = randomImage(180, 150, 7);
+                for(int x = 20; x < 90; ++x) {
+                    edited.at<std::uint8_t>(41, x) = 0;
+                    edited.at<std::uint8_t>(42, x) = 255;
+                }
+                edited.at<std::uint8_t>(170, 3) = 17;
+                ins.setInputImage(edited).builder().exportGCode(output.string());
+                ok &= check(scanned(ins) && matches(edited, 12345), what + ": pixel edit matches a fresh build");
+
+                ins.setInputImage(original).builder().exportGCode(output.string());
+                ok &= check(matches(original, 12345), what + ": reverting the edit matches a fresh build");
+            }
+        }
+    }
+    std::filesystem::remove(output);
+    std::filesystem::remove(fresh);
+    return ok;
+}
+
+// 在 builder() 和 exportGCode() 之间改模态压缩，缓存中的程序仍然与它的键一致
+// Changing modal compression between builder() and exportGCode() still stores every program under its own key
+static bool testCacheKeyFollowsExport() {
+    auto const directory = tempPath("cache-key");
+    std::filesystem::remove_all(directory);
+    GCodeCache cache(directory);
+    auto const mat = randomImage(97, 83, 2);
+    auto const run = [&](bool modalAtBuild, bool modalAtExport, std::string_view name) {
+        ImageToGCode ins;
+        ins.setCache(&cache).setInputImage(mat).setOutputTragetSize(8.3, 9.7, 10).setModalCompression(modalAtBuild).builder();
+        ins.setModalCompression(modalAtExport).exportGCode(tempPath(name).string());
+        return std::pair {ins.isCacheHit(), readFile(tempPath(name))};
+    };
+
+    bool ok                = true;
+    auto const [h0, plain] = run(false, false, "plain.nc");
+    auto const [h1, modal] = run(false, true, "modal.nc");
+    auto const [h2, again] = run(true, true, "again.nc");
+    auto const [h3, back]  = run(true, false, "back.nc");
+    ok &= check(!h0 && !h1 && plain != modal, "first plain and modal exports are generated");
+    ok &= check(h2 && again == modal, "modal program is cached under the modal key");
+    ok &= check(h3 && back == plain, "switching back after builder() serves the plain program");
+    std::filesystem::remove_all(directory);
+    for(auto const *name: {"plain.nc", "modal.nc", "again.nc", "back.nc"}) {
+        std::filesystem::remove(tempPath(name));
+    }
+    return ok;
+}
+
+// 命中之后程序被淘汰时重新生成并再次存入；输出写出失败时返回 false，不重新生成也不存入
+// A program evicted after the hit is generated again and stored again; a failed output write returns false without generating or storing
+static bool testCacheFallback() {
+    auto const directory = tempPath("cache-fallback");
+    std::filesystem::remove_all(directory);
+    GCodeCache cache(directory);
+    auto const mat    = randomImage(211, 173, 3);
+    auto const output = tempPath("fallback.nc");
+    auto const setup  = [&](ImageToGCode &ins) -> ImageToGCode & {
+        return ins.setCache(&cache).setInputImage(mat).setScanMode(ImageToGCode::ScanMode::Bidirection).setOutputTragetSize(17.3, 21.1, 10);
+    };
+
+    ImageToGCode first;
+    setup(first).builder().exportGCode(output.string());
+    auto const expected = readFile(output);
+
+    bool ok = true;
+    ImageToGCode evicted;
+    setup(evicted).builder();
+    ok &= check(evicted.isCacheHit(), "second builder() hits");
+    cache.clear();
+    ok &= check(evicted.exportGCode(output.string()) && !evicted.isCacheHit(), "export after eviction succeeds by generating");
+    ok &= check(readFile(output) == expected, "generated program equals the evicted one");
+    ok &= check(cache.getStatistics().stores == 2, "generated program is stored again");
+
+    // /dev/full 的写入总是失败(Writes to /dev/full always fail)
+    if(std::filesystem::exists("/dev/full")) {
+        ImageToGCode failing;
+        setup(failing).builder();
+        ok &= check(failing.isCacheHit(), "third builder() hits");
+        ok &= check(!failing.exportGCode("/dev/full"), "failed write returns false");
+        ok &= check(cache.getStatistics().stores == 2, "failed write stores nothing");
+    }
+    std::filesystem::remove_all(directory);
+    std::filesystem::remove(output);
+    return ok;
+}
+
+// .tpb 经内存映射读取器读回后指令与原工具路径相同，从块边界附近开始的 forEach 也相同；转换的文本与 exportGCode() 逐字节相同
+// A .tpb read back through the memory-mapped reader holds the same commands as the original toolpath, also for forEach starting around chunk boundaries; the converted text is byte-identical to exportGCode()
+static bool testBinaryToolpathRoundTrip() {
+    constexpr std::size_t chunk = BinaryToolpath::kChunkCommands;
+    auto const same             = [](const Toolpath::Command &a, const Toolpath::Command &b) {
+        return a.op == b.op && a.x == b.x && a.y == b.y && a.s == b.s && a.i == b.i && a.j == b.j;
+    };
+    // 与 path 的第 [first, first + count) 条指令逐条比较(Compare command by command against commands [first, first + count) of path)
+    auto const matches = [&](const BinaryToolpathReader &reader, const Toolpath &path, std::size_t first, std::size_t count) {
+        auto next     = first;
+        auto const ok = reader.forEach([&](const Toolpath::Command &c) { next += next < path.size() && same(c, path[next]) ? 1 : path.size() + 1; }, first, count);
+        return ok && next == std::min(path.size(), first + count);
+    };
+
+    bool ok = true;
+    {
+        // 三块多的指令：G0/G1/G2/G3、负坐标、缺省的 X/Y/S、正负 I/J(A little over three chunks: G0/G1/G2/G3, negative coordinates, omitted X/Y/S and signed I/J)
+        Toolpath path;
+        std::mt19937 random(7);
+        for(std::size_t k = 0; k < 3 * chunk + 123; ++k) {
+            auto const x = static_cast<std::int32_t>(random() % 200001) - 100000;
+            auto const y = static_cast<std::int32_t>(random() % 200001) - 100000;
+            auto const s = k % 3 == 0 ? std::nullopt : std::optional<int>(random() % 1001);
+            switch(k % 5) {
+            case 0: path.push(Toolpath::Motion::G0, x, y, std::nullopt); break;
+            case 1: path.push(Toolpath::Motion::G1, x, k % 2 ? std::nullopt : std::optional(y), s); break;
+            case 2: path.pushArc(Toolpath::Motion::G2, x, y, -static_cast<std::int32_t>(random() % 5000), static_cast<std::int32_t>(random() % 5000), s); break;
+            case 3: path.pushArc(Toolpath::Motion::G3, x, y, static_cast<std::int32_t>(random() % 5000), -static_cast<std::int32_t>(random() % 5000), s); break;
+            default: path.push(Toolpath::Motion::G1, std::nullopt, y, s); break;
+            }
+        }
+        BinaryToolpath::Job job;
+        job.width      = 200;
+        job.height     = 200;
+        job.resolution = 10;
+        job.header     = {"G90", "G21"};
+        job.footer     = {"M5"};
+        auto const file = tempPath("roundtrip.tpb");
+        ok &= check(BinaryToolpath::write(file.string(), path, job), "binary toolpath is written");
+
+        BinaryToolpathReader reader(file.string());
+        ok &= check(reader.isOpen() && reader.size() == path.size(), "reader opens the file and reports every command");
+        ok &= check(reader.getJob().header == job.header && reader.getJob().footer == job.footer && reader.getJob().width == job.width, "job parameters round-trip");
+        Toolpath loaded;
+        bool equal = reader.read(loaded) && loaded.size() == path.size();
+        for(std::size_t k = 0; k < path.size() && equal; ++k) {
+            equal = same(loaded[k], path[k]);
+        }
+        ok &= check(equal, "read() returns every command unchanged");
+        for(auto const first: {std::size_t {0}, chunk - 1, chunk, chunk + 1, 2 * chunk - 1, 3 * chunk, path.size() - 1}) {
+            ok &= check(matches(reader, path, first, 3), std::format("forEach from {} across the chunk boundary", first));
+        }
+        ok &= check(matches(reader, path, chunk - 2, 2 * chunk + 5), "forEach spanning whole chunks");
+        ok &= check(matches(reader, path, 3 * chunk, chunk), "forEach clamps the count at the end");
+        ok &= check(matches(reader, path, path.size(), 10), "forEach from the end visits nothing");
+
+        std::ostringstream expected, converted;
+        {
+            GCodeSink sink(expected);
+            for(auto const &line: job.header) {
+                sink.write(line);
+            }
+            sink.write(path);
+            for(auto const &line: job.footer) {
+                sink.write(line);
+            }
+        }
+        {
+            GCodeSink sink(converted);
+            ok &= check(reader.writeText(sink), "writeText() succeeds");
+        }
+        ok &= check(converted.str() == expected.str(), "converted text equals the text of the toolpath");
+        reader.close();
+        std::filesystem::remove(file);
+    }
+
+    // 实际作业：圆环图像，开启圆弧拟合，模态压缩开和关(A real job: a ring image with arc fitting, modal compression on and off)
+    cv::Mat mat(160, 160, CV_8UC1, 255);
+    for(int y = 0; y < mat.rows; ++y) {
+        for(int x = 0; x < mat.cols; ++x) {
+            auto const r = std::hypot(x - 80.0, y - 80.0);
+            if(r < 70 && static_cast<int>(r) % 20 < 12) {
+                mat.at<std::uint8_t>(y, x) = static_cast<std::uint8_t>((x + y) % 200);
+            }
+        }
+    }
+    auto const text      = tempPath("roundtrip.nc");
+    auto const binary    = tempPath("roundtrip-job.tpb");
+    auto const converted = tempPath("roundtrip-converted.nc");
+    for(auto const mode: {ImageToGCode::ScanMode::Bidirection, ImageToGCode::ScanMode::Contour}) {
+        for(auto const modal: {false, true}) {
+            ImageToGCode ins;
+            ins.setInputImage(mat).setScanMode(mode).setOutputTragetSize(16, 16, 10).setArcFitting(true).setModalCompression(modal).builder();
+            auto const name = std::format("mode {} modal {}", static_cast<int>(mode), modal);
+            ok &= check(ins.exportGCode(text.string()) && ins.exportBinary(binary.string()), name + " exports");
+            BinaryToolpathReader reader(binary.string());
+            ok &= check(reader.isOpen() && matches(reader, ins.getToolpath(), 0, ins.getToolpath().size()), name + " binary holds the toolpath");
+            ok &= check(reader.exportGCode(converted.string()) && readFile(converted) == readFile(text), name + " converted text equals exportGCode()");
+        }
+    }
+    std::filesystem::remove(text);
+    std::filesystem::remove(binary);
+    std::filesystem::remove(converted);
+    return ok;
+}
+
+int main() {
+    std::pair<std::string_view, std::function<bool()>> const tests[] {
+        {"negative zero", testNegativeZero},
+        {"row scanner ISAs", testRowScannerIsas},
+        {"run extraction", testRunExtraction},
+        {"power curves", testPowerCurves},
+        {"arc fitter", testArcFitter},
+        {"dither thread invariance", testDitherThreadInvariance},
+        {"area resampling", testAreaResampling},
+        {"tiled matches in-memory", testTiledMatchesInMemory},
+        {"thread count invariance", testThreadCountInvariance},
+        {"hatch matches bidirection", testHatchMatchesBidirection},
+        {"contour closes polygons", testContourClosesPolygons},
+        {"incremental build", testIncrementalBuild},
+        {"cache key follows export", testCacheKeyFollowsExport},
+        {"cache fallback", testCacheFallback},
+        {"binary toolpath round trip", testBinaryToolpathRoundTrip},
+    };
+    int failed = 0;
+    for(auto const &[name, test]: tests) {
+        auto const ok = test();
+        std::println("{} {}", ok ? "PASS" : "FAIL", name);
+        failed += !ok;
+    }
+    return failed == 0 ? 0 : 1;
+}
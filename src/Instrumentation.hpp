@@ -0,0 +1,195 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <mutex>
+#include <numbers>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Toolpath.hpp"
+
+// 生成过程的计时与工具路径统计。
+// Timing of the generation phases and toolpath statistics.
+// 关闭时每个计时范围只检查一次开关，不读时钟也不加锁；统计在整行/整带的工具路径上进行，不进入逐像素循环。
+// When disabled each timed scope only checks one flag, without reading the clock or locking; statistics are taken on whole rows/bands of toolpath and never enter the per-pixel loops.
+// 同名的计时（包括不同线程上的）累加到一条记录中，流式生成逐行计时也只占用固定的内存。
+// Scopes with the same name, on any thread, accumulate into one record, so per-row timing while streaming still takes constant memory.
+class Instrumentation
+{
+public:
+    // 同名计时的累计，时间单位为微秒，从 reset() 开始计；多个线程并行时总时长可以超过跨度
+    // Accumulated scopes of one name, in microseconds since reset(); with several threads in parallel the total can exceed the span
+    struct Phase {
+        std::string_view name;
+        std::int64_t start;     // 第一次开始(Start of the first scope)
+        std::int64_t end;       // 最后一次结束(End of the last scope)
+        std::int64_t duration;  // 总时长(Total duration)
+        std::uint64_t count;    // 次数(Number of scopes)
+    };
+
+    struct Counters {
+        std::uint64_t g0 {0};            // G0 指令数(G0 commands)
+        std::uint64_t g1 {0};            // G1 指令数(G1 commands)
+        std::uint64_t arcs {0};          // G2/G3 指令数(G2/G3 commands)
+        std::uint64_t powerChanges {0};  // 功率变化次数(Power changes)
+        double rapid {0};                // 空移距离 mm(Rapid distance, mm)
+        double burn {0};                 // 出光距离 mm(Burn distance, mm)
+    };
+
+    // 计时范围，析构时记录；name 必须是字符串字面量
+    // Timed scope, recorded on destruction; name must be a string literal
+    class Scope
+    {
+    public:
+        Scope(Instrumentation &owner, std::string_view name) noexcept : owner(owner.enabled ? &owner : nullptr), name(name) {
+            if(this->owner != nullptr) {
+                start = owner.now();
+            }
+        }
+
+        Scope(const Scope &) = delete;
+
+        Scope &operator=(const Scope &) = delete;
+
+        ~Scope() {
+            if(owner != nullptr) {
+                owner->record(name, start, owner->now() - start);
+            }
+        }
+
+    private:
+        Instrumentation *owner;
+        std::string_view name;
+        std::int64_t start {0};
+    };
+
+    void enable(bool on) noexcept { enabled = on; }
+
+    bool isEnabled() const noexcept { return enabled; }
+
+    // 清空记录，时间原点、位置和功率回到程序开头（G0 X0 Y0，S0）
+    // Clear the records, the time origin, position and power go back to the start of the program (G0 X0 Y0, S0)
+    void reset() {
+        std::lock_guard lock(mutex);
+        origin   = std::chrono::steady_clock::now();
+        phases.clear();
+        counters = {};
+        x        = 0;
+        y        = 0;
+        s        = 0;
+    }
+
+    Scope scope(std::string_view name) noexcept { return {*this, name}; }
+
+    // 累计一段工具路径的统计，按顺序调用时位置和功率在段与段之间延续
+    // Accumulate statistics of a piece of toolpath, position and power carry over between pieces when called in order
+    void count(const Toolpath &path) noexcept {
+        if(!enabled) {
+            return;
+        }
+        for(std::size_t i = 0; i < path.size(); ++i) {
+            auto const c  = path[i];
+            auto const nx = c.hasX() ? c.x : x;
+            auto const ny = c.hasY() ? c.y : y;
+            auto const d  = std::hypot(static_cast<double>(nx - x), static_cast<double>(ny - y)) / 1000.0;
+            if(c.motion() == Toolpath::Motion::G0) {
+                ++counters.g0;
+                counters.rapid += d;
+            } else if(c.isArc()) {
+                ++counters.arcs;
+                counters.burn += arcLength(c, nx, ny) / 1000.0;
+            } else {
+                ++counters.g1;
+                counters.burn += d;
+            }
+            if(c.hasS() && c.s != s) {
+                ++counters.powerChanges;
+                s = c.s;
+            }
+            x = nx;
+            y = ny;
+        }
+    }
+
+    const std::vector<Phase> &getPhases() const noexcept { return phases; }
+
+    const Counters &getCounters() const noexcept { return counters; }
+
+    // 同名计时的总时长，微秒
+    // Total duration of the scopes with this name, in microseconds
+    std::int64_t total(std::string_view name) const noexcept {
+        auto const it = std::ranges::find(phases, name, &Phase::name);
+        return it == phases.end() ? 0 : it->duration;
+    }
+
+    // 导出 Chrome 跟踪格式 (chrome://tracing, Perfetto)，统计作为计数器事件附在末尾
+    // Export in Chrome trace format (chrome://tracing, Perfetto), the statistics are appended as counter events
+    bool exportChromeTrace(const std::string &fileName) const {
+        std::fstream file;
+        file.open(fileName, std::ios_base::out | std::ios_base::trunc);
+        if(!file.is_open()) {
+            return false;
+        }
+
+        file << "{\"traceEvents\":[\n";
+        // 每条记录在自己的一行上画成从第一次开始到最后一次结束的一段，总时长和次数放在参数中
+        // Every record is drawn on its own row as one span from the first start to the last end, with the total duration and count as arguments
+        std::int64_t end = 0;
+        for(std::size_t i = 0; i < phases.size(); ++i) {
+            auto const &p = phases[i];
+            file << std::format(R"({{"name":"{}","ph":"X","pid":1,"tid":{},"ts":{},"dur":{},"args":{{"total":{},"count":{}}}}},)", p.name, i, p.start, p.end - p.start, p.duration, p.count) << '\n';
+            end = std::max(end, p.end);
+        }
+        file << std::format(R"({{"name":"commands","ph":"C","pid":1,"ts":{},"args":{{"G0":{},"G1":{},"arcs":{},"powerChanges":{}}}}},)", end, counters.g0, counters.g1, counters.arcs, counters.powerChanges) << '\n';
+        file << std::format(R"({{"name":"distance","ph":"C","pid":1,"ts":{},"args":{{"rapid":{:.3f},"burn":{:.3f}}}}})", end, counters.rapid, counters.burn) << '\n';
+        file << "]}\n";
+        return file.good();
+    }
+
+private:
+    // 圆弧长度 微米：圆心为起点加 I/J，按运动方向从起点角转到终点角，终点与起点重合时为整圆
+    // Arc length in micrometres: the centre is the start plus I/J, turning from the start angle to the end angle in the direction of motion, a full circle when the end equals the start
+    double arcLength(const Toolpath::Command &c, std::int32_t nx, std::int32_t ny) const noexcept {
+        auto const cx = static_cast<double>(x) + c.i;
+        auto const cy = static_cast<double>(y) + c.j;
+        auto const a0 = std::atan2(y - cy, x - cx);
+        auto const a1 = std::atan2(ny - cy, nx - cx);
+        auto sweep    = c.motion() == Toolpath::Motion::G3 ? a1 - a0 : a0 - a1;
+        while(sweep <= 0) {
+            sweep += 2 * std::numbers::pi;
+        }
+        return sweep * std::hypot(static_cast<double>(c.i), static_cast<double>(c.j));
+    }
+
+    std::int64_t now() const noexcept {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    void record(std::string_view name, std::int64_t start, std::int64_t duration) {
+        std::lock_guard lock(mutex);
+        auto const it = std::ranges::find(phases, name, &Phase::name);
+        if(it == phases.end()) {
+            phases.push_back({name, start, start + duration, duration, 1});
+            return;
+        }
+        it->start = std::min(it->start, start);
+        it->end   = std::max(it->end, start + duration);
+        it->duration += duration;
+        ++it->count;
+    }
+
+private:
+    bool enabled {false};
+    std::chrono::steady_clock::time_point origin {std::chrono::steady_clock::now()};
+    std::mutex mutex;
+    std::vector<Phase> phases;
+    Counters counters;
+    std::int32_t x {0};  // 当前位置 微米(Current position, micrometre)
+    std::int32_t y {0};
+    std::uint16_t s {0};  // 当前功率(Current power)
+};
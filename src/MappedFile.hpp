@@ -0,0 +1,160 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#if defined(_WIN32)
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// 只读内存映射文件。页面由操作系统按需载入，已处理的区域可以调用 release() 交还，常驻内存不随文件大小增长。
+// Read-only memory-mapped file. Pages are loaded on demand by the OS and processed ranges can be handed back with release(), so resident memory does not grow with the file size.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+
+    explicit MappedFile(const std::string &fileName) { open(fileName); }
+
+    MappedFile(const MappedFile &) = delete;
+
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    MappedFile(MappedFile &&other) noexcept { swap(other); }
+
+    MappedFile &operator=(MappedFile &&other) noexcept {
+        if(this != &other) {
+            close();
+            swap(other);
+        }
+        return *this;
+    }
+
+    ~MappedFile() { close(); }
+
+    bool open(const std::string &fileName) {
+        close();
+#if defined(_WIN32)
+        file = ::CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if(file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER length {};
+        if(!::GetFileSizeEx(file, &length) || length.QuadPart == 0) {
+            close();
+            return false;
+        }
+        mapping = ::CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if(mapping == nullptr) {
+            close();
+            return false;
+        }
+        auto *view = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if(view == nullptr) {
+            close();
+            return false;
+        }
+        bytes = static_cast<const std::uint8_t *>(view);
+        count = static_cast<std::size_t>(length.QuadPart);
+#else
+        int const fd = ::open(fileName.c_str(), O_RDONLY);
+        if(fd < 0) {
+            return false;
+        }
+        struct stat info {};
+        if(::fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        auto *view = ::mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(view == MAP_FAILED) {
+            return false;
+        }
+        ::madvise(view, static_cast<std::size_t>(info.st_size), MADV_SEQUENTIAL);
+        bytes = static_cast<const std::uint8_t *>(view);
+        count = static_cast<std::size_t>(info.st_size);
+#endif
+        return true;
+    }
+
+    void close() noexcept {
+#if defined(_WIN32)
+        if(bytes != nullptr) {
+            ::UnmapViewOfFile(bytes);
+        }
+        if(mapping != nullptr) {
+            ::CloseHandle(mapping);
+        }
+        if(file != INVALID_HANDLE_VALUE) {
+            ::CloseHandle(file);
+        }
+        mapping = nullptr;
+        file    = INVALID_HANDLE_VALUE;
+#else
+        if(bytes != nullptr) {
+            ::munmap(const_cast<std::uint8_t *>(bytes), count);
+        }
+#endif
+        bytes = nullptr;
+        count = 0;
+    }
+
+    // 告诉操作系统 [offset, offset + length) 暂时不再需要，可以从常驻内存中移除
+    // Tell the OS that [offset, offset + length) is not needed for now and may be dropped from resident memory
+    void release(std::size_t offset, std::size_t length) const noexcept {
+        if(bytes == nullptr || offset >= count) {
+            return;
+        }
+        length = std::min(length, count - offset);
+#if defined(_WIN32)
+        // Windows 的只读映射页面由系统工作集管理自动回收
+        // Read-only mapped pages are trimmed by the Windows working set manager on its own
+        (void)length;
+#else
+        auto const page  = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        auto const begin = (offset + page - 1) / page * page;
+        auto const end   = (offset + length) / page * page;
+        if(end > begin) {
+            ::madvise(const_cast<std::uint8_t *>(bytes) + begin, end - begin, MADV_DONTNEED);
+        }
+#endif
+    }
+
+    const std::uint8_t *data() const noexcept { return bytes; }
+
+    std::size_t size() const noexcept { return count; }
+
+    bool isOpen() const noexcept { return bytes != nullptr; }
+
+private:
+    void swap(MappedFile &other) noexcept {
+        std::swap(bytes, other.bytes);
+        std::swap(count, other.count);
+#if defined(_WIN32)
+        std::swap(file, other.file);
+        std::swap(mapping, other.mapping);
+#endif
+    }
+
+private:
+    const std::uint8_t *bytes {nullptr};
+    std::size_t count {0};
+#if defined(_WIN32)
+    HANDLE file {INVALID_HANDLE_VALUE};
+    HANDLE mapping {nullptr};
+#endif
+};
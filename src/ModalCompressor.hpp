@@ -0,0 +1,128 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+
+#include "Toolpath.hpp"
+
+// 模态压缩：跟踪控制器已保持的状态（运动模式、X/Y、S），只输出发生变化的字段，
+// 并把同向共线、功率相同的连续移动合并为一条。
+// Modal compression: tracks the state the controller already holds (motion mode, X/Y, S), only emits the words that change,
+// and merges consecutive collinear moves in the same direction with equal power into a single move.
+// 进给速度 F 只在头部设置一次，主体中不会重复出现，因此无需跟踪。
+// The feed rate F is only set once in the header and never repeated in the body, so it needs no tracking.
+class ModalCompressor
+{
+public:
+    // 以头部建立的状态作为起点
+    // Start from the state established by the header
+    void reset(Toolpath::Motion motion, std::int32_t x, std::int32_t y, std::uint16_t s) noexcept {
+        state   = {motion, x, y, s};
+        pending = std::nullopt;
+    }
+
+    // 压缩 in 并追加到 out。最后一条移动可能暂存等待合并，结束时需调用 finish()。
+    // Compress in and append to out. The last move may be held back for merging, call finish() at the end.
+    void compress(const Toolpath &in, Toolpath &out) {
+        for(std::size_t i = 0; i < in.size(); ++i) {
+            feed(in[i], out);
+        }
+    }
+
+    void finish(Toolpath &out) {
+        if(pending.has_value()) {
+            flush(*pending, out);
+            pending = std::nullopt;
+        }
+    }
+
+private:
+    struct State {
+        Toolpath::Motion motion;
+        std::int32_t x, y;
+        std::uint16_t s;
+    };
+
+    struct Move {
+        Toolpath::Motion motion;
+        std::int32_t x0, y0;  // 起点(start)
+        std::int32_t x1, y1;  // 终点(end)
+        std::uint16_t s;
+    };
+
+    void feed(const Toolpath::Command &c, Toolpath &out) {
+        if(c.isArc()) {
+            arc(c, out);
+            return;
+        }
+
+        // 当前位置及功率（包含暂存的移动）
+        // Current position and power (including the pending move)
+        auto const cx = pending ? pending->x1 : state.x;
+        auto const cy = pending ? pending->y1 : state.y;
+        auto const cs = pending ? pending->s : state.s;
+
+        auto const motion = c.motion();
+        auto const x      = c.hasX() ? c.x : cx;
+        auto const y      = c.hasY() ? c.y : cy;
+        auto const s      = c.hasS() ? c.s : cs;
+
+        // 不移动也不改变功率的指令没有任何效果
+        // A command that neither moves nor changes power has no effect
+        if(x == cx && y == cy && s == cs) {
+            return;
+        }
+
+        if(pending) {
+            auto &p = *pending;
+            if(p.motion == motion && p.s == s && continues(p, x, y)) {
+                p.x1 = x;
+                p.y1 = y;
+                return;
+            }
+            flush(p, out);
+        }
+        pending = Move {motion, cx, cy, x, y, s};
+    }
+
+    // (x, y) 是否位于 p 的延长线上且方向相同
+    // Whether (x, y) lies on the extension of p in the same direction
+    static bool continues(const Move &p, std::int32_t x, std::int32_t y) noexcept {
+        auto const dx1 = static_cast<std::int64_t>(p.x1) - p.x0;
+        auto const dy1 = static_cast<std::int64_t>(p.y1) - p.y0;
+        auto const dx2 = static_cast<std::int64_t>(x) - p.x1;
+        auto const dy2 = static_cast<std::int64_t>(y) - p.y1;
+        return dx1 * dy2 - dy1 * dx2 == 0 && dx1 * dx2 + dy1 * dy2 >= 0;
+    }
+
+    // 圆弧不与其他移动合并；X/Y 与 I/J 照常写出，只省略未变化的功率和运动模式
+    // Arcs are never merged; X/Y and I/J are written as is and only unchanged power and motion are omitted
+    void arc(const Toolpath::Command &c, Toolpath &out) {
+        if(pending.has_value()) {
+            flush(*pending, out);
+            pending = std::nullopt;
+        }
+        auto const s = c.hasS() ? c.s : state.s;
+        auto op      = static_cast<std::uint8_t>(c.op & (Toolpath::kMotionMask | Toolpath::kHasX | Toolpath::kHasY));
+        op |= s != state.s ? Toolpath::kHasS : 0;
+        op |= c.motion() == state.motion ? Toolpath::kModal : 0;
+        out.push({op, c.x, c.y, s, c.i, c.j});
+        state = {c.motion(), c.hasX() ? c.x : state.x, c.hasY() ? c.y : state.y, s};
+    }
+
+    void flush(const Move &p, Toolpath &out) {
+        std::uint8_t op = static_cast<std::uint8_t>(p.motion);
+        op |= p.x1 != state.x ? Toolpath::kHasX : 0;
+        op |= p.y1 != state.y ? Toolpath::kHasY : 0;
+        op |= p.s != state.s ? Toolpath::kHasS : 0;
+        op |= p.motion == state.motion ? Toolpath::kModal : 0;
+        if(!(op & (Toolpath::kHasX | Toolpath::kHasY | Toolpath::kHasS))) {
+            return;
+        }
+        out.push({op, p.x1, p.y1, p.s});
+        state = {p.motion, p.x1, p.y1, p.s};
+    }
+
+private:
+    State state {Toolpath::Motion::G0, 0, 0, 0};
+    std::optional<Move> pending;
+};
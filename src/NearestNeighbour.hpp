@@ -0,0 +1,130 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+// 最近邻查询的网格空间索引。每个点属于一个对象（出光链的两端、轮廓的各个顶点），取走一个点时它所属对象的全部点一并作废。
+// Grid spatial index for nearest-neighbour queries. Every point belongs to an owner (both ends of a burn chain, the vertices of a contour) and taking a point retires every point of its owner.
+// 查找时从查询点所在的格子按环向外扩展，直到不可能再找到更近的点；已作废的点在经过时才从格子中移除。
+// A query expands ring by ring from the cell of the query point until no closer point is possible; retired points are removed from a cell when it is next visited.
+class NearestNeighbour
+{
+public:
+    struct Point {
+        std::int64_t x, y;
+    };
+
+    // 点所属的对象和它在对象内的序号(The owner of the point and its index within the owner)
+    struct Entry {
+        std::uint32_t owner;
+        std::uint32_t index;
+        Point point;
+    };
+
+    // owners 为对象数，平均每格约 perCell 个点；细长区域时网格不超过点数的两倍
+    // owners is the number of owners and cells hold about perCell points on average; for long thin extents the grid stays within twice the number of points
+    NearestNeighbour(const std::vector<Entry> &entries, std::size_t owners, int perCell) : taken(owners, 0) {
+        if(entries.empty()) {
+            return;
+        }
+        lo       = entries[0].point;
+        Point hi = lo;
+        for(auto const &e: entries) {
+            lo = {std::min(lo.x, e.point.x), std::min(lo.y, e.point.y)};
+            hi = {std::max(hi.x, e.point.x), std::max(hi.y, e.point.y)};
+        }
+        auto const area = static_cast<double>(hi.x - lo.x + 1) * static_cast<double>(hi.y - lo.y + 1);
+        auto const n    = static_cast<std::int64_t>(entries.size());
+        auto const side = std::max(hi.x - lo.x, hi.y - lo.y);
+        cell            = std::max({std::int64_t {1}, static_cast<std::int64_t>(std::sqrt(area * perCell / static_cast<double>(n))), side / (2 * n) + 1});
+        gx              = static_cast<int>((hi.x - lo.x) / cell + 1);
+        gy              = static_cast<int>((hi.y - lo.y) / cell + 1);
+
+        grid.resize(static_cast<std::size_t>(gx) * gy);
+        for(auto const &e: entries) {
+            grid[static_cast<std::size_t>(cy(e.point)) * gx + cx(e.point)].push_back(e);
+        }
+    }
+
+    bool isTaken(std::uint32_t owner) const noexcept { return taken[owner] != 0; }
+
+    // 取走离 from 最近的点并作废它的对象，没有剩余的点时返回空。距离相同时取 (对象, 序号) 小的点，结果是确定的。
+    // Take the point closest to from and retire its owner, empty when no point is left. Ties go to the lower (owner, index), so the result is deterministic.
+    std::optional<Entry> take(Point from) {
+        if(grid.empty()) {
+            return std::nullopt;
+        }
+
+        auto const px = std::clamp(cx(from), 0, gx - 1);
+        auto const py = std::clamp(cy(from), 0, gy - 1);
+        auto best     = std::numeric_limits<double>::infinity();
+        Entry pick {};
+        auto const before = [](const Entry &a, const Entry &b) { return a.owner != b.owner ? a.owner < b.owner : a.index < b.index; };
+        auto const visit  = [&](int x, int y) {
+            auto &bucket = grid[static_cast<std::size_t>(y) * gx + x];
+            for(std::size_t k = 0; k < bucket.size();) {
+                auto const &e = bucket[k];
+                if(taken[e.owner]) {
+                    bucket[k] = bucket.back();
+                    bucket.pop_back();
+                    continue;
+                }
+                auto const dx = static_cast<double>(e.point.x - from.x);
+                auto const dy = static_cast<double>(e.point.y - from.y);
+                auto const d  = dx * dx + dy * dy;
+                if(d < best || (d == best && before(e, pick))) {
+                    best = d;
+                    pick = e;
+                }
+                ++k;
+            }
+        };
+        for(int r = 0;; ++r) {
+            for(int x = px - r; x <= px + r; ++x) {
+                for(int y: {py - r, py + r}) {
+                    if(x >= 0 && x < gx && y >= 0 && y < gy) {
+                        visit(x, y);
+                    }
+                    if(r == 0) {
+                        break;
+                    }
+                }
+            }
+            for(int y = py - r + 1; y <= py + r - 1; ++y) {
+                for(int x: {px - r, px + r}) {
+                    if(x >= 0 && x < gx && y >= 0 && y < gy) {
+                        visit(x, y);
+                    }
+                }
+            }
+            // 下一环中的点距离至少为 r * cell(Points in the next ring are at least r * cell away)
+            auto const reach   = static_cast<double>(r) * static_cast<double>(cell);
+            auto const outside = px - r <= 0 && py - r <= 0 && px + r >= gx - 1 && py + r >= gy - 1;
+            if(best <= reach * reach || outside) {
+                break;
+            }
+        }
+
+        if(best == std::numeric_limits<double>::infinity()) {
+            return std::nullopt;
+        }
+        taken[pick.owner] = 1;
+        return pick;
+    }
+
+private:
+    int cx(Point p) const noexcept { return static_cast<int>(std::clamp<std::int64_t>((p.x - lo.x) / cell, -1, gx)); }
+
+    int cy(Point p) const noexcept { return static_cast<int>(std::clamp<std::int64_t>((p.y - lo.y) / cell, -1, gy)); }
+
+private:
+    std::vector<std::vector<Entry>> grid;
+    std::vector<char> taken;
+    Point lo {0, 0};
+    std::int64_t cell {1};
+    int gx {0};
+    int gy {0};
+};
@@ -0,0 +1,136 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include <numbers>
+#include <utility>
+
+// 灰度到激光功率 S 的传递曲线，预先计算为 256 项查找表，扫描时只做查表，没有逐像素的浮点运算。
+// Gray level to laser power S transfer curve, precomputed into a 256-entry lookup table so scanning only does a table lookup and no per-pixel floating point.
+// 内置曲线都是 constexpr，可以在编译期生成。灰度 255 为空白，功率恒为 0。
+// The built-in curves are constexpr and can be generated at compile time. Gray 255 is blank and its power is always 0.
+class PowerCurve
+{
+public:
+    using Table = std::array<std::uint16_t, 256>;
+
+    // 线性：S = (1 - gray / 255) * sMax，截断取整，sMax 为 1000 时与旧版公式逐值相同
+    // Linear: S = (1 - gray / 255) * sMax truncated, identical to the legacy formula for every gray level when sMax is 1000
+    static constexpr PowerCurve linear(int sMax = 1000) {
+        PowerCurve curve;
+        for(int g = 0; g < 255; ++g) {
+            curve.table[g] = static_cast<std::uint16_t>((1.0 - static_cast<double>(g) / 255.0) * sMax);
+        }
+        return curve;
+    }
+
+    // 伽马：S = (1 - gray / 255) ^ gamma * sMax，gamma > 1 压暗浅色部分，gamma < 1 提亮
+    // Gamma: S = (1 - gray / 255) ^ gamma * sMax, gamma > 1 weakens light tones and gamma < 1 strengthens them
+    static constexpr PowerCurve gamma(double gamma, int sMax = 1000) {
+        PowerCurve curve;
+        for(int g = 0; g < 255; ++g) {
+            curve.table[g] = static_cast<std::uint16_t>(power(1.0 - static_cast<double>(g) / 255.0, gamma) * sMax);
+        }
+        return curve;
+    }
+
+    // 分段线性材料曲线：points 为按灰度升序排列的 (灰度, 功率) 控制点，点之间线性插值，两端保持端点功率
+    // Piecewise linear material curve: points are (gray, power) control points in ascending gray order, interpolated linearly in between and held constant beyond the ends
+    static constexpr PowerCurve piecewise(std::initializer_list<std::pair<int, int>> points) {
+        PowerCurve curve;
+        if(points.size() == 0) {
+            return curve;
+        }
+        for(int g = 0; g < 255; ++g) {
+            auto const *next = std::find_if(points.begin(), points.end(), [g](const auto &p) { return p.first >= g; });
+            int value        = 0;
+            if(next == points.begin()) {
+                value = next->second;
+            } else if(next == points.end()) {
+                value = (points.end() - 1)->second;
+            } else {
+                auto const &[g0, s0] = *(next - 1);
+                auto const &[g1, s1] = *next;
+                auto const num       = (s1 - s0) * (g - g0);
+                auto const den       = g1 - g0;
+                value                = s0 + (num * 2 + (num < 0 ? -den : den)) / (den * 2);  // 四舍五入(rounded)
+            }
+            curve.table[g] = static_cast<std::uint16_t>(std::max(0, value));
+        }
+        return curve;
+    }
+
+    // 把非空白灰度的功率限制在 [minS, maxS]，用于材料的起燃功率和上限
+    // Limit the power of non-blank gray levels to [minS, maxS], for the ignition threshold and the ceiling of a material
+    constexpr PowerCurve &clamp(int minS, int maxS) {
+        for(int g = 0; g < 255; ++g) {
+            table[g] = static_cast<std::uint16_t>(std::clamp<int>(table[g], minS, maxS));
+        }
+        return *this;
+    }
+
+    constexpr int operator()(std::uint8_t gray) const noexcept { return table[gray]; }
+
+    constexpr const Table &getTable() const noexcept { return table; }
+
+private:
+    // 编译期可用的 x ^ y (0 <= x <= 1)，exp(y * ln(x))。
+    // Compile-time x ^ y (0 <= x <= 1) as exp(y * ln(x)).
+    static constexpr double power(double x, double y) {
+        if(x <= 0.0) {
+            return y == 0.0 ? 1.0 : 0.0;
+        }
+        return exp(y * log(x));
+    }
+
+    // ln(x) = e * ln2 + 2 * atanh((m - 1) / (m + 1))，m 在 [0.75, 1.5) 内
+    // ln(x) = e * ln2 + 2 * atanh((m - 1) / (m + 1)) with m in [0.75, 1.5)
+    static constexpr double log(double x) {
+        int e = 0;
+        while(x >= 1.5) {
+            x /= 2.0;
+            ++e;
+        }
+        while(x < 0.75) {
+            x *= 2.0;
+            --e;
+        }
+        auto const z  = (x - 1.0) / (x + 1.0);
+        auto const z2 = z * z;
+        double term = z, sum = 0.0;
+        for(int k = 1; k < 40; k += 2) {
+            sum += term / k;
+            term *= z2;
+        }
+        return e * std::numbers::ln2 + 2.0 * sum;
+    }
+
+    // exp(y) = 2^k * exp(r)，|r| <= ln2 / 2
+    // exp(y) = 2^k * exp(r) with |r| <= ln2 / 2
+    static constexpr double exp(double y) {
+        if(y < -700.0) {
+            return 0.0;
+        }
+        auto const k = static_cast<int>(y / std::numbers::ln2 + (y < 0 ? -0.5 : 0.5));
+        auto const r = y - k * std::numbers::ln2;
+        double term = 1.0, sum = 1.0;
+        for(int n = 1; n < 30; ++n) {
+            term *= r / n;
+            sum += term;
+        }
+        for(int i = 0; i < k; ++i) {
+            sum *= 2.0;
+        }
+        for(int i = 0; i > k; --i) {
+            sum /= 2.0;
+        }
+        return sum;
+    }
+
+private:
+    Table table {};
+};
+
+// 与旧版公式 (1 - pixel / 255) * 1000 一致(Matches the legacy formula (1 - pixel / 255) * 1000)
+static_assert(PowerCurve::linear()(0) == 1000 && PowerCurve::linear()(128) == 498 && PowerCurve::linear()(254) == 3 && PowerCurve::linear()(255) == 0);
@@ -0,0 +1,143 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// 面积重采样（区域平均），整数定点运算，按输出行工作。
+// Area resampling (box average) in integer fixed point, working one output row at a time.
+// 每个输出行只取决于它覆盖的源行，与分条方式无关，因此整图处理和分条处理的结果逐字节相同。
+// Every output row only depends on the source rows it covers and not on how the work is split into strips, so whole-image and strip-wise processing give identical bytes.
+class AreaResampler
+{
+public:
+    static constexpr int kWeightBits = 14;  // 每个方向的权重精度(Weight precision per axis)
+
+    AreaResampler(int srcCols, int srcRows, int dstCols, int dstRows)
+        : dstCols(dstCols)
+        , xTaps(makeTaps(srcCols, dstCols))
+        , yTaps(makeTaps(srcRows, dstRows))
+        , accumulator(dstCols) {
+        for(auto &row: cache) {
+            row.values.resize(dstCols);
+        }
+    }
+
+    // 生成输出行 [r0, r1) 所需的源行范围 [first, last)
+    // The range of source rows [first, last) needed to produce output rows [r0, r1)
+    std::pair<int, int> sourceRows(int r0, int r1) const noexcept {
+        return {yTaps.first[r0], yTaps.first[r1 - 1] + yTaps.count(r1 - 1)};
+    }
+
+    // 生成输出行 [r0, r1)，sourceRow(y) 返回第 y 个源行的指针，out 指向第 r0 行，行间距为 step 字节；lut 不为空时输出前经过 256 项查找表（阈值、色调曲线）
+    // Produce output rows [r0, r1), sourceRow(y) returns a pointer to source row y, out points to row r0 and rows are step bytes apart; a non-null lut maps every output through a 256-entry table (threshold, tone curve)
+    template<class SourceRow>
+    void resample(int r0, int r1, SourceRow &&sourceRow, std::uint8_t *out, std::size_t step, const std::uint8_t *lut = nullptr) {
+        for(int r = r0; r < r1; ++r, out += step) {
+            std::fill(accumulator.begin(), accumulator.end(), 0);
+            for(int k = 0, n = yTaps.count(r); k < n; ++k) {
+                auto const weight  = yTaps.weights[yTaps.offset[r] + k];
+                auto const &values = horizontal(yTaps.first[r] + k, sourceRow);
+                for(int x = 0; x < dstCols; ++x) {
+                    accumulator[x] += static_cast<std::uint64_t>(weight) * values[x];
+                }
+            }
+            constexpr auto shift = 2 * kWeightBits;
+            constexpr auto half  = std::uint64_t {1} << (shift - 1);
+            if(lut == nullptr) {
+                for(int x = 0; x < dstCols; ++x) {
+                    out[x] = static_cast<std::uint8_t>((accumulator[x] + half) >> shift);
+                }
+            } else {
+                for(int x = 0; x < dstCols; ++x) {
+                    out[x] = lut[(accumulator[x] + half) >> shift];
+                }
+            }
+        }
+    }
+
+private:
+    // 每个输出像素覆盖的源像素及其权重，权重之和恒为 1 << kWeightBits
+    // The source pixels covered by each output pixel and their weights, which always sum to 1 << kWeightBits
+    struct Taps {
+        std::vector<int> first;               // 第一个源像素(first source pixel)
+        std::vector<int> offset;              // 权重在 weights 中的起始位置，多一个哨兵(start of the weights, with one sentinel)
+        std::vector<std::uint32_t> weights;
+
+        int count(int i) const noexcept { return offset[i + 1] - offset[i]; }
+    };
+
+    // 输出像素 d 覆盖源区间 [d*n/m, (d+1)*n/m)，以 1/m 为单位全部用整数计算
+    // Output pixel d covers source interval [d*n/m, (d+1)*n/m), computed entirely in integers in units of 1/m
+    static Taps makeTaps(int n, int m) {
+        Taps taps;
+        taps.first.resize(m);
+        taps.offset.resize(m + 1);
+        constexpr std::uint32_t unit = 1u << kWeightBits;
+        for(int d = 0; d < m; ++d) {
+            auto const begin = static_cast<std::int64_t>(d) * n;
+            auto const end   = begin + n;
+            auto const s0    = static_cast<int>(begin / m);
+            auto const s1    = static_cast<int>(std::min<std::int64_t>(n, (end + m - 1) / m));
+
+            taps.first[d]  = s0;
+            taps.offset[d] = static_cast<int>(taps.weights.size());
+            std::uint32_t sum   = 0;
+            std::size_t largest = taps.weights.size();
+            for(int s = s0; s < s1; ++s) {
+                auto const overlap = std::min<std::int64_t>(end, static_cast<std::int64_t>(s + 1) * m) - std::max<std::int64_t>(begin, static_cast<std::int64_t>(s) * m);
+                auto const weight  = static_cast<std::uint32_t>(overlap * unit / n);
+                if(s > s0 && weight > taps.weights[largest]) {
+                    largest = taps.weights.size();
+                }
+                taps.weights.push_back(weight);
+                sum += weight;
+            }
+            // 舍入误差补到最大的权重上，保证权重之和精确为 1
+            // Put the rounding error on the largest weight so the weights sum to exactly one
+            taps.weights[largest] += unit - sum;
+        }
+        taps.offset[m] = static_cast<int>(taps.weights.size());
+        return taps;
+    }
+
+    struct CachedRow {
+        int y {-1};
+        std::vector<std::uint32_t> values;
+    };
+
+    // 源行的水平方向结果。相邻输出行会共用边界上的源行，缓存最近的两行避免重复计算。
+    // Horizontal pass of a source row. Neighbouring output rows share the source rows on their boundary, so the last two are cached.
+    template<class SourceRow>
+    const std::vector<std::uint32_t> &horizontal(int y, SourceRow &&sourceRow) {
+        for(auto &row: cache) {
+            if(row.y == y) {
+                return row.values;
+            }
+        }
+        auto &row = cache[next];
+        next      = 1 - next;
+        row.y     = y;
+
+        std::uint8_t const *src = sourceRow(y);
+        for(int x = 0; x < dstCols; ++x) {
+            std::uint32_t sum = 0;
+            auto const *w     = xTaps.weights.data() + xTaps.offset[x];
+            auto const *p     = src + xTaps.first[x];
+            for(int k = 0, n = xTaps.count(x); k < n; ++k) {
+                sum += w[k] * p[k];
+            }
+            row.values[x] = sum;
+        }
+        return row.values;
+    }
+
+private:
+    int dstCols;
+    Taps xTaps;
+    Taps yTaps;
+    std::vector<std::uint64_t> accumulator;
+    std::array<CachedRow, 2> cache;
+    int next {0};
+};
@@ -0,0 +1,134 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+    #define IMAGETOGCODE_X86 1
+    #include <immintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #endif
+#endif
+
+#if defined(IMAGETOGCODE_X86) && (defined(__GNUC__) || defined(__clang__))
+    #define IMAGETOGCODE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+    #define IMAGETOGCODE_TARGET_AVX2
+#endif
+
+// 灰度行扫描器：查找下一个灰度不在 [lo, hi] 内的像素，即空白/非空白边界或功率变化边界。
+// Grayscale row scanner: finds the next pixel whose gray level is outside [lo, hi], i.e. the next blank/non-blank or power-change boundary.
+// 每次比较 16 (SSE2) 或 32 (AVX2) 个像素，运行时按 CPU 选择实现，其他平台使用标量版本。
+// Compares 16 (SSE2) or 32 (AVX2) pixels at a time, the implementation is selected at runtime from the CPU, other platforms use the scalar version.
+class RowScanner
+{
+public:
+    enum class Isa {
+        Scalar,
+        SSE2,
+        AVX2,
+    };
+
+    using FindOutside = int (*)(const std::uint8_t *pixels, int i, int n, std::uint8_t lo, std::uint8_t hi) noexcept;
+
+    // 下标 i 起第一个灰度不在 [lo, hi] 内的位置，不存在时返回 n
+    // First index from i whose gray level is outside [lo, hi], n when there is none
+    static int findOutside(const std::uint8_t *pixels, int i, int n, std::uint8_t lo, std::uint8_t hi) noexcept {
+        static FindOutside const impl = get(best());
+        return impl(pixels, i, n, lo, hi);
+    }
+
+    static bool supported(Isa isa) noexcept {
+        switch(isa) {
+            case Isa::Scalar: return true;
+#if defined(IMAGETOGCODE_X86)
+            case Isa::SSE2: return true;  // x86-64 的基础指令集(baseline of x86-64)
+            case Isa::AVX2: return hasAvx2();
+#else
+            case Isa::SSE2:
+            case Isa::AVX2: return false;
+#endif
+        }
+        return false;
+    }
+
+    static Isa best() noexcept {
+        if(supported(Isa::AVX2)) {
+            return Isa::AVX2;
+        }
+        if(supported(Isa::SSE2)) {
+            return Isa::SSE2;
+        }
+        return Isa::Scalar;
+    }
+
+    static FindOutside get(Isa isa) noexcept {
+#if defined(IMAGETOGCODE_X86)
+        switch(isa) {
+            case Isa::Scalar: return &findOutsideScalar;
+            case Isa::SSE2: return &findOutsideSSE2;
+            case Isa::AVX2: return &findOutsideAVX2;
+        }
+#endif
+        (void)isa;
+        return &findOutsideScalar;
+    }
+
+    static int findOutsideScalar(const std::uint8_t *pixels, int i, int n, std::uint8_t lo, std::uint8_t hi) noexcept {
+        auto const range = static_cast<std::uint8_t>(hi - lo);
+        while(i < n && static_cast<std::uint8_t>(pixels[i] - lo) <= range) {
+            ++i;
+        }
+        return i;
+    }
+
+#if defined(IMAGETOGCODE_X86)
+    // x 在 [lo, hi] 内等价于 无符号 (x - lo) <= (hi - lo)，饱和减法结果为 0 即在范围内
+    // x is in [lo, hi] iff unsigned (x - lo) <= (hi - lo), i.e. the saturating subtraction yields 0
+    static int findOutsideSSE2(const std::uint8_t *pixels, int i, int n, std::uint8_t lo, std::uint8_t hi) noexcept {
+        auto const vlo    = _mm_set1_epi8(static_cast<char>(lo));
+        auto const vrange = _mm_set1_epi8(static_cast<char>(hi - lo));
+        auto const zero   = _mm_setzero_si128();
+        for(; i + 16 <= n; i += 16) {
+            auto const v    = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pixels + i));
+            auto const over = _mm_subs_epu8(_mm_sub_epi8(v, vlo), vrange);
+            auto const mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(over, zero)));
+            if(mask != 0xFFFFu) {
+                return i + std::countr_one(mask);
+            }
+        }
+        return findOutsideScalar(pixels, i, n, lo, hi);
+    }
+
+    IMAGETOGCODE_TARGET_AVX2 static int findOutsideAVX2(const std::uint8_t *pixels, int i, int n, std::uint8_t lo, std::uint8_t hi) noexcept {
+        auto const vlo    = _mm256_set1_epi8(static_cast<char>(lo));
+        auto const vrange = _mm256_set1_epi8(static_cast<char>(hi - lo));
+        auto const zero   = _mm256_setzero_si256();
+        for(; i + 32 <= n; i += 32) {
+            auto const v    = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pixels + i));
+            auto const over = _mm256_subs_epu8(_mm256_sub_epi8(v, vlo), vrange);
+            auto const mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(over, zero)));
+            if(mask != 0xFFFFFFFFu) {
+                return i + std::countr_one(mask);
+            }
+        }
+        return findOutsideSSE2(pixels, i, n, lo, hi);
+    }
+
+private:
+    static bool hasAvx2() noexcept {
+    #if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        bool const osxsave = info[2] & (1 << 27);
+        if(!osxsave || (_xgetbv(0) & 0x6) != 0x6) {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return info[1] & (1 << 5);
+    #else
+        return __builtin_cpu_supports("avx2");
+    #endif
+    }
+#endif
+};
@@ -0,0 +1,89 @@
+#include <chrono>
+#include <print>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "RowScanner.hpp"
+
+// 行扫描基准：在不同分辨率的 tigger.jpg 上比较 逐像素 at<> 循环 与 标量/SSE2/AVX2 行扫描器
+// Row scanner benchmark: compares the per-pixel at<> loop with the scalar/SSE2/AVX2 row scanner on tigger.jpg at several resolutions
+
+// 旧版写法：逐像素 at<> 比较，统计游程数量
+// Legacy style: per-pixel at<> comparison, counting runs
+static std::size_t countRunsLegacy(const cv::Mat &image) {
+    std::size_t runs = 0;
+    for(int y = 0; y < image.rows; ++y) {
+        for(int x = 0; x < image.cols; ++x) {
+            auto const pixel = image.at<uchar>(y, x);
+            while(++x < image.cols && image.at<std::uint8_t>(y, x) == pixel) {
+            }
+            --x;
+            ++runs;
+        }
+    }
+    return runs;
+}
+
+static std::size_t countRuns(const cv::Mat &image, RowScanner::FindOutside find) {
+    std::size_t runs = 0;
+    for(int y = 0; y < image.rows; ++y) {
+        auto const *row = image.ptr<std::uint8_t>(y);
+        for(int x = 0; x < image.cols; ++runs) {
+            x = find(row, x + 1, image.cols, row[x], row[x]);
+        }
+    }
+    return runs;
+}
+
+template<class F>
+static double measure(F &&f, std::size_t &runs) {
+    constexpr int repeat = 5;
+    double best          = 1e300;
+    for(int i = 0; i < repeat; ++i) {
+        auto const begin = std::chrono::steady_clock::now();
+        runs             = f();
+        auto const end   = std::chrono::steady_clock::now();
+        best             = std::min(best, std::chrono::duration<double, std::milli>(end - begin).count());
+    }
+    return best;
+}
+
+int main(int argc, char *argv[]) {
+    std::string const path = argc > 1 ? argv[1] : "image/tigger.jpg";
+    cv::Mat source         = cv::imread(path, cv::IMREAD_GRAYSCALE);
+    if(source.empty()) {
+        std::println("can not read {}", path);
+        return 1;
+    }
+
+    std::println("AVX2 {}", RowScanner::supported(RowScanner::Isa::AVX2) ? "available" : "not available");
+    std::println("{:>6} {:>10} {:>12} {:>10} {:>10} {:>10} {:>8}", "size", "kind", "runs", "at<> ms", "scalar ms", "SSE2 ms", "AVX2 ms");
+
+    for(int size: {600, 1200, 2400, 4800, 9600}) {
+        cv::Mat gray;
+        cv::resize(source, gray, cv::Size(size, size));
+        cv::Mat binary;
+        cv::threshold(gray, binary, 128, 255, cv::ThresholdTypes::THRESH_BINARY);
+
+        for(auto const &[kind, image]: {std::pair<const char *, cv::Mat> {"gray", gray}, {"binary", binary}}) {
+            std::size_t reference = 0;
+            std::size_t runs      = 0;
+            auto const legacy     = measure([&] { return countRunsLegacy(image); }, reference);
+
+            double timing[3] {};
+            for(auto isa: {RowScanner::Isa::Scalar, RowScanner::Isa::SSE2, RowScanner::Isa::AVX2}) {
+                if(!RowScanner::supported(isa)) {
+                    continue;
+                }
+                timing[static_cast<int>(isa)] = measure([&] { return countRuns(image, RowScanner::get(isa)); }, runs);
+                if(runs != reference) {
+                    std::println("run count mismatch: {} vs {}", runs, reference);
+                    return 1;
+                }
+            }
+            std::println("{:>6} {:>10} {:>12} {:>10.2f} {:>10.2f} {:>10.2f} {:>8.2f}", size, kind, reference, legacy, timing[0], timing[1], timing[2]);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "RowScanner.hpp"
+
+// 游程：一段连续且灰度相近的像素。value 为 255 表示空白（不出光）。
+// Run: a sequence of consecutive pixels with similar gray level. A value of 255 means blank (laser off).
+struct Run {
+    int start;           // 起始下标，包含(start index, inclusive)
+    int end;             // 结束下标，不包含(end index, exclusive)
+    std::uint8_t value;  // 代表灰度(representative gray level)
+};
+
+// 把任意像素序列切分为游程，所有扫描方式共用。
+// Split any pixel sequence into runs, shared by every scan order.
+// 空白像素单独成段；非空白像素与段首像素的灰度差不超过 tolerance 时归入同一段，代表灰度取段内平均值。
+// Blank pixels always form their own runs; a non-blank pixel joins the current run while it is within tolerance of the first pixel, and the representative gray level is the run average.
+inline void extractRuns(std::span<const std::uint8_t> pixels, int tolerance, std::vector<Run> &runs) {
+    auto const *p = pixels.data();
+    auto const n  = static_cast<int>(pixels.size());
+    for(int i = 0; i < n;) {
+        auto const v = p[i];
+        if(v == 255) {
+            auto const j = RowScanner::findOutside(p, i + 1, n, 255, 255);
+            runs.push_back({i, j, 255});
+            i = j;
+            continue;
+        }
+
+        auto const lo = static_cast<std::uint8_t>(std::max(0, v - tolerance));
+        auto const hi = static_cast<std::uint8_t>(std::min(254, v + tolerance));
+        auto const j  = RowScanner::findOutside(p, i + 1, n, lo, hi);
+        if(tolerance == 0) {
+            runs.push_back({i, j, v});
+        } else {
+            unsigned sum = 0;
+            for(int k = i; k < j; ++k) {
+                sum += p[k];
+            }
+            auto const count = static_cast<unsigned>(j - i);
+            runs.push_back({i, j, static_cast<std::uint8_t>((sum + count / 2) / count)});
+        }
+        i = j;
+    }
+}
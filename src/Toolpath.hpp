@@ -0,0 +1,200 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "Common.hpp"
+
+// 工具路径中间表示，采用结构体数组(SoA)布局：操作码、整型 X/Y（微米）、功率。圆弧的 I/J 在出现第一条圆弧时才分配。
+// Toolpath intermediate representation in struct-of-arrays layout: opcode, integer X/Y (micrometre) and power. The I/J of arcs are only allocated once the first arc appears.
+// 扫描策略只写入数字，文本只在导出时生成，后处理也可以直接在数字上进行。
+// Strategies only emit numbers, text is produced at export time and post-processing passes work on plain numbers.
+class Toolpath
+{
+public:
+    // 运动模式(Motion mode)
+    enum class Motion : std::uint8_t {
+        G0 = 0,  // 快速移动(Rapid move)
+        G1 = 1,  // 直线插补(Linear move)
+        G2 = 2,  // 顺时针圆弧(Clockwise arc)
+        G3 = 3,  // 逆时针圆弧(Counterclockwise arc)
+    };
+
+    // 操作码低 4 位为运动模式，高位标记哪些字段存在
+    // The low 4 bits of the opcode hold the motion mode, the high bits mark which words are present
+    static constexpr std::uint8_t kMotionMask = 0x0F;
+    static constexpr std::uint8_t kHasX       = 0x10;
+    static constexpr std::uint8_t kHasY       = 0x20;
+    static constexpr std::uint8_t kHasS       = 0x40;
+    static constexpr std::uint8_t kModal      = 0x80;  // 沿用上一条的运动模式，不输出 G 字(Motion is modal, the G word is not written)
+
+    struct Command {
+        std::uint8_t op;
+        std::int32_t x;  // 微米(micrometre)
+        std::int32_t y;  // 微米(micrometre)
+        std::uint16_t s;
+        std::int32_t i {0};  // 圆弧圆心相对起点的偏移 微米(Arc centre offset from the start, micrometre)
+        std::int32_t j {0};
+
+        constexpr Motion motion() const noexcept { return static_cast<Motion>(op & kMotionMask); }
+
+        constexpr bool hasX() const noexcept { return op & kHasX; }
+
+        constexpr bool hasY() const noexcept { return op & kHasY; }
+
+        constexpr bool hasS() const noexcept { return op & kHasS; }
+
+        constexpr bool isModal() const noexcept { return op & kModal; }
+
+        constexpr bool isArc() const noexcept { return motion() == Motion::G2 || motion() == Motion::G3; }
+    };
+
+    // 毫米转微米，先收窄为 float 再取整，保证与旧版 G0/G1 的 {:.3f} 输出逐字节一致。
+    // Millimetre to micrometre. The value is narrowed to float first so the result matches the legacy G0/G1 {:.3f} output byte for byte.
+    // float 只有 24 位尾数，乘以 1000 在 double 中是精确的，std::llrint 的就近偶数舍入与格式化一致。
+    // float has a 24-bit mantissa so the product with 1000 is exact in double, and std::llrint rounds half to even like the formatter.
+    static std::int32_t toMicro(double mm) noexcept {
+        return static_cast<std::int32_t>(std::llrint(static_cast<double>(static_cast<float>(mm)) * 1000.0));
+    }
+
+    void push(Motion motion, std::optional<std::int32_t> x, std::optional<std::int32_t> y, std::optional<int> s) {
+        std::uint8_t code = static_cast<std::uint8_t>(motion);
+        code |= x.has_value() ? kHasX : 0;
+        code |= y.has_value() ? kHasY : 0;
+        code |= s.has_value() ? kHasS : 0;
+        op.push_back(code);
+        xs.push_back(x.value_or(0));
+        ys.push_back(y.value_or(0));
+        ss.push_back(static_cast<std::uint16_t>(s.value_or(0)));
+        if(!is.empty()) {
+            is.push_back(0);
+            js.push_back(0);
+        }
+    }
+
+    // 圆弧：终点 X/Y 和圆心偏移 I/J 总是写出(Arc: the end point X/Y and the centre offset I/J are always written)
+    void pushArc(Motion motion, std::int32_t x, std::int32_t y, std::int32_t i, std::int32_t j, std::optional<int> s) {
+        push({static_cast<std::uint8_t>(static_cast<std::uint8_t>(motion) | kHasX | kHasY | (s.has_value() ? kHasS : 0)), x, y, static_cast<std::uint16_t>(s.value_or(0)), i, j});
+    }
+
+    void push(const Command &c) {
+        op.push_back(c.op);
+        xs.push_back(c.x);
+        ys.push_back(c.y);
+        ss.push_back(c.s);
+        if(c.isArc() && is.empty()) {
+            is.resize(op.size() - 1, 0);
+            js.resize(op.size() - 1, 0);
+        }
+        // 第一条指令就是圆弧时 resize 之后仍为空(Still empty after the resize when the very first command is an arc)
+        if(!is.empty() || c.isArc()) {
+            is.push_back(c.i);
+            js.push_back(c.j);
+        }
+    }
+
+    void emplace_back(const G0 &g) {
+        push(Motion::G0, g.x.transform(toMicro), g.y.transform(toMicro), g.s);
+    }
+
+    void emplace_back(const G1 &g) {
+        push(Motion::G1, g.x.transform(toMicro), g.y.transform(toMicro), g.s);
+    }
+
+    void emplace_back(const G2 &g) {
+        pushArc(Motion::G2, toMicro(g.x.value_or(0)), toMicro(g.y.value_or(0)), toMicro(g.i), toMicro(g.j), g.s);
+    }
+
+    void emplace_back(const G3 &g) {
+        pushArc(Motion::G3, toMicro(g.x.value_or(0)), toMicro(g.y.value_or(0)), toMicro(g.i), toMicro(g.j), g.s);
+    }
+
+    void append(const Toolpath &other) {
+        append(other, 0, other.size());
+    }
+
+    // 追加 other 的第 [begin, end) 条指令(Append commands [begin, end) of other)
+    void append(const Toolpath &other, std::size_t begin, std::size_t end) {
+        if(is.empty() && !other.is.empty()) {
+            is.resize(op.size(), 0);
+            js.resize(op.size(), 0);
+        }
+        if(!is.empty() || !other.is.empty()) {
+            if(other.is.empty()) {
+                is.resize(is.size() + (end - begin), 0);
+                js.resize(js.size() + (end - begin), 0);
+            } else {
+                is.insert(is.end(), other.is.begin() + begin, other.is.begin() + end);
+                js.insert(js.end(), other.js.begin() + begin, other.js.begin() + end);
+            }
+        }
+        op.insert(op.end(), other.op.begin() + begin, other.op.begin() + end);
+        xs.insert(xs.end(), other.xs.begin() + begin, other.xs.begin() + end);
+        ys.insert(ys.end(), other.ys.begin() + begin, other.ys.begin() + end);
+        ss.insert(ss.end(), other.ss.begin() + begin, other.ss.begin() + end);
+    }
+
+    Command operator[](std::size_t i) const noexcept {
+        return {op[i], xs[i], ys[i], ss[i], is.empty() ? 0 : is[i], is.empty() ? 0 : js[i]};
+    }
+
+    std::size_t size() const noexcept { return op.size(); }
+
+    bool empty() const noexcept { return op.empty(); }
+
+    void reserve(std::size_t n) {
+        op.reserve(n);
+        xs.reserve(n);
+        ys.reserve(n);
+        ss.reserve(n);
+    }
+
+    void clear() noexcept {
+        op.clear();
+        xs.clear();
+        ys.clear();
+        ss.clear();
+        is.clear();
+        js.clear();
+    }
+
+    // 将第 i 条指令编码为一行 G 代码（不含换行），返回写入末尾
+    // Encode the i-th command as one line of G-code (without newline) and return the end of the written bytes
+    char *encode(char *out, std::size_t i) const noexcept {
+        char *const begin = out;
+        auto const word   = [&](char w) {
+            if(out != begin) {
+                *out++ = ' ';
+            }
+            *out++ = w;
+            return out;
+        };
+
+        if(!(op[i] & kModal)) {
+            out = GCodeEncoder::writeMotion(out, op[i] & kMotionMask);
+        }
+        if(op[i] & kHasX) {
+            out = GCodeEncoder::writeMicro(word('X'), xs[i]);
+        }
+        if(op[i] & kHasY) {
+            out = GCodeEncoder::writeMicro(word('Y'), ys[i]);
+        }
+        if(auto const motion = static_cast<Motion>(op[i] & kMotionMask); motion == Motion::G2 || motion == Motion::G3) {
+            out = GCodeEncoder::writeMicro(word('I'), is[i]);
+            out = GCodeEncoder::writeMicro(word('J'), js[i]);
+        }
+        if(op[i] & kHasS) {
+            out = GCodeEncoder::writeInt(word('S'), ss[i]);
+        }
+        return out;
+    }
+
+private:
+    std::vector<std::uint8_t> op;   // 操作码(opcode)
+    std::vector<std::int32_t> xs;   // X 微米(X micrometre)
+    std::vector<std::int32_t> ys;   // Y 微米(Y micrometre)
+    std::vector<std::uint16_t> ss;  // 功率(power)
+    std::vector<std::int32_t> is;   // 圆弧 I 微米，没有圆弧时为空(Arc I micrometre, empty while there are no arcs)
+    std::vector<std::int32_t> js;   // 圆弧 J 微米(Arc J micrometre)
+};
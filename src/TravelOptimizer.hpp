@@ -0,0 +1,241 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "NearestNeighbour.hpp"
+#include "Toolpath.hpp"
+
+// 空移优化：把工具路径切分为出光链（连续的 G1），重新排列链的顺序和方向，使链与链之间的 G0 总距离尽量短。
+// Travel optimization: splits the toolpath into burn chains (consecutive G1 moves) and reorders and reverses the chains so the total G0 distance between them is as short as possible.
+// 先用网格空间索引做最近邻构造，再在滑动窗口内做 2-opt 改进；超出时间预算时剩余的链保持原顺序，已完成的改进保留。
+// A nearest-neighbour tour is built with a grid spatial index and then improved by 2-opt within a sliding window; once the time budget runs out the remaining chains keep their original order and the improvements made so far are kept.
+// 每段 G1 的起止点和功率都不变，只是可能反向走；链内部不拆开，因此行内的蛇形顺序得以保留。
+// Every G1 segment keeps its end points and power and may only be traversed backwards; chains are never split, so the serpentine order within rows is kept.
+class TravelOptimizer
+{
+public:
+    struct Report {
+        double before {0};        // 优化前空移距离 mm(Rapid distance before, mm)
+        double after {0};         // 优化后空移距离 mm(Rapid distance after, mm)
+        std::size_t chains {0};   // 出光链数量(Number of burn chains)
+        bool complete {false};    // 是否在时间预算内完成(Whether it finished within the time budget)
+    };
+
+    explicit TravelOptimizer(std::chrono::milliseconds budget = std::chrono::milliseconds(1000), int window = 32)
+        : budget(budget)
+        , window(static_cast<std::size_t>(std::max(2, window))) {}
+
+    // 优化 path（未经模态压缩的工具路径），起点为 G0 X0 Y0、S0
+    // Optimize path (a toolpath before modal compression), starting from G0 X0 Y0, S0
+    Report optimize(Toolpath &path) {
+        deadline = std::chrono::steady_clock::now() + budget;
+        split(path);
+
+        Report report;
+        report.chains = chains.size();
+        report.before = rapid / 1000.0;
+        if(chains.size() < 2) {
+            report.after    = report.before;
+            report.complete = true;
+            return report;
+        }
+
+        auto tour       = identity();
+        report.complete = nearestNeighbour(tour) && twoOpt(tour);
+        if(travel(tour) >= travel(identity())) {
+            tour = identity();
+        }
+        report.after = travel(tour) / 1000.0;
+        emit(tour, path);
+        return report;
+    }
+
+private:
+    struct Point {
+        std::int64_t x, y;  // 微米(micrometre)
+    };
+
+    // 出光链：commands[first, last) 中的 G1，从 start 走到 end
+    // Burn chain: the G1 moves in commands[first, last), going from start to end
+    struct Chain {
+        std::size_t first, last;
+        Point start, end;
+    };
+
+    struct Step {
+        std::uint32_t chain;
+        bool reversed;
+    };
+
+    // 绝对坐标和有效功率，省略的字段沿用前一条指令
+    // Absolute coordinates and effective power, omitted words keep the value of the previous command
+    struct Move {
+        Point to;
+        std::uint16_t s;
+        bool hasS;
+    };
+
+    void split(const Toolpath &path) {
+        moves.clear();
+        chains.clear();
+        rapid = 0;
+        Point at {0, 0};
+        std::uint16_t s = 0;
+        bool burning    = false;
+        for(std::size_t i = 0; i < path.size(); ++i) {
+            auto const c     = path[i];
+            Point const from = at;
+            at = {c.hasX() ? c.x : at.x, c.hasY() ? c.y : at.y};
+            s  = c.hasS() ? c.s : s;
+            if(c.motion() != Toolpath::Motion::G1) {
+                rapid += distance(from, at);
+                burning = false;
+                continue;  // G0 只用于连接，重新生成(G0 only connects chains and is regenerated)
+            }
+            if(!burning) {
+                chains.push_back({moves.size(), moves.size(), from, from});
+                burning = true;
+            }
+            moves.push_back({at, s, c.hasS()});
+            chains.back().last = moves.size();
+            chains.back().end  = at;
+        }
+    }
+
+    std::vector<Step> identity() const {
+        std::vector<Step> tour(chains.size());
+        for(std::size_t i = 0; i < chains.size(); ++i) {
+            tour[i] = {static_cast<std::uint32_t>(i), false};
+        }
+        return tour;
+    }
+
+    static bool same(Point a, Point b) noexcept { return a.x == b.x && a.y == b.y; }
+
+    static double distance(Point a, Point b) noexcept {
+        return std::hypot(static_cast<double>(a.x - b.x), static_cast<double>(a.y - b.y));
+    }
+
+    Point head(Step s) const noexcept { return s.reversed ? chains[s.chain].end : chains[s.chain].start; }
+
+    Point tail(Step s) const noexcept { return s.reversed ? chains[s.chain].start : chains[s.chain].end; }
+
+    double travel(const std::vector<Step> &tour) const noexcept {
+        double sum = 0;
+        Point at {0, 0};
+        for(auto const &s: tour) {
+            sum += distance(at, head(s));
+            at = tail(s);
+        }
+        return sum;
+    }
+
+    bool expired() const noexcept { return std::chrono::steady_clock::now() > deadline; }
+
+    // 最近邻构造。空间索引中存放链的两个端点，每格平均约两个端点。
+    // Nearest-neighbour construction. The spatial index holds both end points of every chain, about two per cell.
+    bool nearestNeighbour(std::vector<Step> &tour) {
+        std::vector<NearestNeighbour::Entry> ends;
+        ends.reserve(chains.size() * 2);
+        for(std::uint32_t i = 0; i < chains.size(); ++i) {
+            ends.push_back({i, 0, {chains[i].start.x, chains[i].start.y}});
+            ends.push_back({i, 1, {chains[i].end.x, chains[i].end.y}});
+        }
+        NearestNeighbour index(ends, chains.size(), 2);
+
+        Point at {0, 0};
+        for(std::size_t n = 0; n < chains.size(); ++n) {
+            if((n & 255) == 0 && expired()) {
+                // 超时：剩余的链按原顺序接在后面(Out of time: the remaining chains follow in their original order)
+                for(std::uint32_t i = 0; i < chains.size(); ++i) {
+                    if(!index.isTaken(i)) {
+                        tour[n++] = {i, false};
+                    }
+                }
+                return false;
+            }
+
+            // 距离相同时取下标小的链、正向，使结果与原扫描顺序一致(Ties go to the lower chain and the forward end, following the original scan order)
+            auto const pick = *index.take({at.x, at.y});
+            tour[n]         = {pick.owner, pick.index != 0};
+            at              = tail(tour[n]);
+        }
+        return true;
+    }
+
+    // 窗口 2-opt：反转 tour[i..j]（顺序和每条链的方向一起反转），只考虑 j - i < window，直到没有改进或超时。
+    // Windowed 2-opt: reverse tour[i..j] (both the order and the direction of every chain), only for j - i < window, until nothing improves or time runs out.
+    bool twoOpt(std::vector<Step> &tour) {
+        auto const n = tour.size();
+        for(bool improved = true; improved;) {
+            improved = false;
+            for(std::size_t i = 0; i < n; ++i) {
+                if((i & 255) == 0 && expired()) {
+                    return false;
+                }
+                auto const before = i == 0 ? Point {0, 0} : tail(tour[i - 1]);
+                for(std::size_t j = i + 1; j < std::min(n, i + window); ++j) {
+                    auto const hasNext = j + 1 < n;
+                    auto const oldCost = distance(before, head(tour[i])) + (hasNext ? distance(tail(tour[j]), head(tour[j + 1])) : 0.0);
+                    auto const newCost = distance(before, tail(tour[j])) + (hasNext ? distance(head(tour[i]), head(tour[j + 1])) : 0.0);
+                    if(newCost + 1e-6 < oldCost) {
+                        std::reverse(tour.begin() + static_cast<std::ptrdiff_t>(i), tour.begin() + static_cast<std::ptrdiff_t>(j) + 1);
+                        for(auto k = i; k <= j; ++k) {
+                            tour[k].reversed = !tour[k].reversed;
+                        }
+                        improved = true;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    // 按新顺序重新生成工具路径：每条链前一条 G0，只输出变化的坐标；功率在顺序改变后可能不再是模态延续的，因此显式写出。
+    // Rebuild the toolpath in the new order: one G0 before each chain with only the coordinates that change; power may no longer carry over modally once the order changes, so it is written explicitly.
+    void emit(const std::vector<Step> &tour, Toolpath &path) const {
+        Toolpath out;
+        out.reserve(moves.size() + chains.size());
+        Point at {0, 0};
+        std::uint16_t s = 0;
+        auto const move = [&](Toolpath::Motion motion, Point to, std::optional<int> power) {
+            auto const x = to.x != at.x || (to.y == at.y && motion == Toolpath::Motion::G1);
+            out.push(motion, x ? std::optional(static_cast<std::int32_t>(to.x)) : std::nullopt, to.y != at.y ? std::optional(static_cast<std::int32_t>(to.y)) : std::nullopt, power);
+            at = to;
+        };
+        auto const burn = [&](Point to, const Move &m) {
+            move(Toolpath::Motion::G1, to, m.hasS || m.s != s ? std::optional<int>(m.s) : std::nullopt);
+            s = m.s;
+        };
+
+        for(auto const &step: tour) {
+            auto const &c = chains[step.chain];
+            if(!same(at, head(step))) {
+                move(Toolpath::Motion::G0, head(step), std::nullopt);
+            }
+            if(!step.reversed) {
+                for(auto k = c.first; k < c.last; ++k) {
+                    burn(moves[k].to, moves[k]);
+                }
+            } else {
+                // 反向时第 k 段从 moves[k].to 走回上一点，功率仍为 moves[k].s(Backwards, segment k runs from moves[k].to back to the previous point, still at moves[k].s)
+                for(auto k = c.last; k-- > c.first;) {
+                    burn(k > c.first ? moves[k - 1].to : c.start, moves[k]);
+                }
+            }
+        }
+        path = std::move(out);
+    }
+
+private:
+    std::chrono::milliseconds budget;
+    std::size_t window;
+    std::chrono::steady_clock::time_point deadline;
+    std::vector<Move> moves;
+    std::vector<Chain> chains;
+    double rapid {0};  // 原路径的 G0 距离 微米(G0 distance of the original path, micrometre)
+};
@@ -0,0 +1,147 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// 工作窃取线程池：任务预先轮流分到每个线程的双端队列，线程从自己的队头取任务，空了就从其他线程的队尾窃取。
+// Work-stealing pool: jobs are dealt round-robin into one deque per thread, each thread takes from the front of its own deque and steals from the back of the others once it runs dry.
+// 任务耗时差别很大（图像大小不同）时，不会有线程早早空闲而其他线程还排着长队。
+// When job times vary a lot (images of different sizes) no thread sits idle while others still have a long queue.
+// 工作线程在构造时启动、析构时结束，每次 run() 只唤醒它们，调用线程本身作为 0 号线程参与。
+// The worker threads start in the constructor and stop in the destructor, each run() only wakes them and the calling thread takes part as worker 0.
+class WorkStealingPool
+{
+public:
+    explicit WorkStealingPool(int threads) : queues(static_cast<std::size_t>(std::max(1, threads))) {
+        for(int t = 1; t < size(); ++t) {
+            workers.emplace_back([this, t] { loop(t); });
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool &)            = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+    }
+
+    int size() const noexcept { return static_cast<int>(queues.size()); }
+
+    // 执行任务 [0, count)，f(worker, job) 中 worker 为线程编号，可用于索引每个线程自己的缓冲区。第一个异常在所有线程结束后重新抛出。
+    // Run jobs [0, count), in f(worker, job) worker is the thread index, usable to index per-thread buffers. The first exception is rethrown after every thread has finished.
+    // 同一时刻只能有一个 run()，不能在任务内部再次调用。
+    // Only one run() at a time, it must not be called again from inside a job.
+    template<class F>
+    void run(std::size_t count, F &&f) {
+        for(std::size_t i = 0; i < count; ++i) {
+            queues[i % queues.size()].jobs.push_back(i);
+        }
+
+        std::function<void(int, std::size_t)> job = std::ref(f);
+        error                                      = nullptr;
+        if(size() > 1 && count > 1) {
+            {
+                std::lock_guard lock(mutex);
+                task   = &job;
+                active = size() - 1;
+                ++generation;
+            }
+            wake.notify_all();
+            work(0);
+            std::unique_lock lock(mutex);
+            idle.wait(lock, [this] { return active == 0; });
+            task = nullptr;
+        } else {
+            work(0, job);
+        }
+        if(error) {
+            std::rethrow_exception(std::exchange(error, nullptr));
+        }
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::size_t> jobs;
+    };
+
+    void work(int worker) { work(worker, *task); }
+
+    void work(int worker, const std::function<void(int, std::size_t)> &f) {
+        while(auto const job = next(worker)) {
+            try {
+                f(worker, *job);
+            } catch(...) {
+                std::lock_guard lock(errorMutex);
+                if(!error) {
+                    error = std::current_exception();
+                }
+            }
+        }
+    }
+
+    // 工作线程等待下一次 run()，做完后通知调用线程(A worker waits for the next run() and tells the calling thread once it is done)
+    void loop(int worker) {
+        std::size_t seen = 0;
+        std::unique_lock lock(mutex);
+        while(true) {
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if(stopping) {
+                return;
+            }
+            seen = generation;
+            lock.unlock();
+            work(worker);
+            lock.lock();
+            if(--active == 0) {
+                idle.notify_one();
+            }
+        }
+    }
+
+    std::optional<std::size_t> next(int worker) {
+        {
+            auto &own = queues[worker];
+            std::lock_guard lock(own.mutex);
+            if(!own.jobs.empty()) {
+                auto const job = own.jobs.front();
+                own.jobs.pop_front();
+                return job;
+            }
+        }
+        // 从下一个线程开始依次窃取(Steal starting from the next thread)
+        for(std::size_t k = 1; k < queues.size(); ++k) {
+            auto &victim = queues[(worker + k) % queues.size()];
+            std::lock_guard lock(victim.mutex);
+            if(!victim.jobs.empty()) {
+                auto const job = victim.jobs.back();
+                victim.jobs.pop_back();
+                return job;
+            }
+        }
+        return std::nullopt;
+    }
+
+private:
+    std::vector<Queue> queues;
+    std::mutex mutex;
+    std::condition_variable wake, idle;
+    const std::function<void(int, std::size_t)> *task {nullptr};
+    std::size_t generation {0};
+    int active {0};
+    bool stopping {false};
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    std::vector<std::jthread> workers;  // 最后声明，析构时最先汇合(Declared last so they are joined first on destruction)
+};
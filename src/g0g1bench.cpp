@@ -0,0 +1,129 @@
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <optional>
+#include <print>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Common.hpp"
+#include "Toolpath.hpp"
+
+// G0/G1 格式化微基准：旧版 std::format 拼接 与 to_chars 编码器 / 微米整数编码器 对比
+// G0/G1 formatting micro-benchmark: the legacy std::format concatenation versus the to_chars encoder and the integer micrometre encoder
+
+// 旧版实现，仅作为基准和正确性参照
+// Legacy implementation, kept only as baseline and reference for correctness
+static std::string legacyToString(int motion, std::optional<float> x, std::optional<float> y, std::optional<int> s) {
+    std::string command = std::format("G{:d}", motion);
+    if(x.has_value()) {
+        command += std::format(" X{:.3f}", x.value());
+    }
+    if(y.has_value()) {
+        command += std::format(" Y{:.3f}", y.value());
+    }
+    if(s.has_value()) {
+        command += std::format(" S{:d}", s.value());
+    }
+    return command;
+}
+
+struct Sample {
+    int motion;
+    std::optional<float> x, y;
+    std::optional<int> s;
+};
+
+template<class F>
+static double measure(const char *name, std::size_t count, std::size_t &bytes, F &&f) {
+    auto const begin = std::chrono::steady_clock::now();
+    bytes            = f();
+    auto const end   = std::chrono::steady_clock::now();
+    auto const ns    = std::chrono::duration<double, std::nano>(end - begin).count() / static_cast<double>(count);
+    std::println("{:<28} {:8.2f} ns/cmd  ({} bytes)", name, ns, bytes);
+    return ns;
+}
+
+int main() {
+    // 模拟扫描策略的输出：坐标为 像素/分辨率，功率 0-1000
+    // Mimic strategy output: coordinates are pixel/resolution, power in 0-1000
+    std::vector<Sample> samples;
+    std::mt19937 rng(20240101);
+    for(double resolution: {10.0, 20.0, 3.0, 16.0, 25.4}) {
+        for(int i = 0; i < 200000; ++i) {
+            auto const x = static_cast<float>(i % 6000 / resolution);
+            auto const y = static_cast<float>(i / 6000 / resolution);
+            switch(rng() % 3) {
+                case 0: samples.push_back({0, x, std::nullopt, std::nullopt}); break;
+                case 1: samples.push_back({1, x, std::nullopt, static_cast<int>(rng() % 1001)}); break;
+                default: samples.push_back({0, x, y, std::nullopt}); break;
+            }
+        }
+    }
+
+    Toolpath path;
+    for(auto &v: samples) {
+        if(v.motion == 0) {
+            path.emplace_back(G0 {v.x, v.y, v.s});
+        } else {
+            path.emplace_back(G1 {v.x, v.y, v.s});
+        }
+    }
+
+    // 正确性：三种编码输出必须逐字节相同
+    // Correctness: all three encodings must produce identical bytes
+    char line[GCodeEncoder::kMaxLine];
+    char lineIR[GCodeEncoder::kMaxLine];
+    for(std::size_t i = 0; i < samples.size(); ++i) {
+        auto const &v   = samples[i];
+        auto const ref  = legacyToString(v.motion, v.x, v.y, v.s);
+        auto const fast = std::string_view(line, GCodeEncoder::encode(line, v.motion, v.x, v.y, v.s));
+        auto const ir   = std::string_view(lineIR, path.encode(lineIR, i));
+        if(ref != fast || ref != ir) {
+            std::println("mismatch at {}: \"{}\" \"{}\" \"{}\"", i, ref, fast, ir);
+            return 1;
+        }
+    }
+    std::println("{} commands verified identical", samples.size());
+
+    std::size_t bytes = 0;
+    std::vector<char> buffer(samples.size() * 32);
+
+    auto const legacy = measure("std::format (legacy)", samples.size(), bytes, [&] {
+        std::size_t n = 0;
+        for(auto &v: samples) {
+            n += legacyToString(v.motion, v.x, v.y, v.s).size() + 1;
+        }
+        return n;
+    });
+
+    auto const toString = measure("G0/G1::toString", samples.size(), bytes, [&] {
+        std::size_t n = 0;
+        for(auto &v: samples) {
+            n += (v.motion == 0 ? G0 {v.x, v.y, v.s}.toString() : G1 {v.x, v.y, v.s}.toString()).size() + 1;
+        }
+        return n;
+    });
+
+    auto const encoder = measure("GCodeEncoder (float)", samples.size(), bytes, [&] {
+        char *out = buffer.data();
+        for(auto &v: samples) {
+            out    = GCodeEncoder::encode(out, v.motion, v.x, v.y, v.s);
+            *out++ = '\n';
+        }
+        return static_cast<std::size_t>(out - buffer.data());
+    });
+
+    auto const micro = measure("Toolpath (micrometre)", samples.size(), bytes, [&] {
+        char *out = buffer.data();
+        for(std::size_t i = 0; i < path.size(); ++i) {
+            out    = path.encode(out, i);
+            *out++ = '\n';
+        }
+        return static_cast<std::size_t>(out - buffer.data());
+    });
+
+    std::println("speedup toString {:.1f}x, encoder {:.1f}x, micrometre {:.1f}x", legacy / toString, legacy / encoder, legacy / micro);
+    return 0;
+}
@@ -3,71 +3,7 @@
 #include <print>
 #include <format>
 
-struct G0 {
-    std::optional<float> x, y;
-    std::optional<int> s;
-
-    std::string toString() {
-        std::string command = "G0";
-        if(x.has_value()) {
-            command += std::format(" X{:.3f}", x.value());
-        }
-        if(y.has_value()) {
-            command += std::format(" Y{:.3f}", y.value());
-        }
-        if(s.has_value()) {
-            command += std::format(" S{:d}", s.value());
-        }
-        return command;
-    }
-
-    explicit operator std::string() const {
-        std::string command = "G0";
-        if(x.has_value()) {
-            command += std::format(" X{:.3f}", x.value());
-        }
-        if(y.has_value()) {
-            command += std::format(" Y{:.3f}", y.value());
-        }
-        if(s.has_value()) {
-            command += std::format(" S{:d}", s.value());
-        }
-        return command;
-    }
-};
-
-struct G1 {
-    std::optional<float> x, y;
-    std::optional<int> s;
-
-    std::string toString() {
-        std::string command = "G1";
-        if(x.has_value()) {
-            command += std::format(" X{:.3f}", x.value());
-        }
-        if(y.has_value()) {
-            command += std::format(" Y{:.3f}", y.value());
-        }
-        if(s.has_value()) {
-            command += std::format(" S{:d}", s.value());
-        }
-        return command;
-    }
-
-    explicit operator std::string() const {
-        std::string command = "G1";
-        if(x.has_value()) {
-            command += std::format(" X{:.3f}", x.value());
-        }
-        if(y.has_value()) {
-            command += std::format(" Y{:.3f}", y.value());
-        }
-        if(s.has_value()) {
-            command += std::format(" S{:d}", s.value());
-        }
-        return command;
-    }
-};
+#include "Common.hpp"
 
 int main()
 {
@@ -1,19 +1,324 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <optional>
 #include <print>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 #include "ImageToGCode.h"
+#include "WorkStealingPool.hpp"
 
-int main() {
-    // 写入你自己的路径
-    cv::Mat mat = cv::imread(R"(\ImageToGCode\image\tigger.jpg)", cv::IMREAD_GRAYSCALE);
-    cv::flip(mat, mat, 0);
+// 批量转换：输入可以是单个图像、图像目录或清单文件，任务在工作窃取线程池上并行执行，每个线程复用自己的 ImageToGCode（条带缓冲、工具路径等）。
+// Batch conversion: the input is a single image, a directory of images or a manifest file; jobs run in parallel on a work-stealing pool and every thread reuses its own ImageToGCode (strip buffer, toolpath and so on).
+//
+// ImageToGCode <图像|目录|清单(image|directory|manifest)> [-o 输出目录(output directory)] [--size WxH] [--resolution N] [--scan 方式(mode)] [--laser M3|M4]
+//              [--threads N] [--no-flip] [--dither 方式(method)|none] [--cache 缓存目录(cache directory)] [--cache-size MB]
+//              [--binary]
+//
+// 默认与单幅转换相同：图像垂直翻转（图像 Y 向下，机床 Y 向上），Floyd-Steinberg 抖动；--no-flip 和 --dither none 取消
+// Defaults match the single-image conversion: the image is flipped vertically (image Y points down, machine Y up) and Floyd-Steinberg dithered; --no-flip and --dither none turn them off
+//
+// 清单每行一个任务，# 开头为注释：图像路径 [输出路径|output=输出路径] [size=WxH] [resolution=N] [scan=方式] [laser=M3|M4]，未给出的参数使用命令行的值，相对路径以清单所在目录为基准
+// A manifest holds one job per line, # starts a comment: image path [output path|output=output path] [size=WxH] [resolution=N] [scan=mode] [laser=M3|M4], parameters not given take the command line values and relative paths are relative to the directory of the manifest
 
-    cv::threshold(mat, mat, 128, 255, cv::ThresholdTypes::THRESH_BINARY);
+namespace fs = std::filesystem;
 
-    //cv::imshow("mat",mat);
-    //cv::waitKey(0);
+struct Job {
+    fs::path input;
+    fs::path output;
+    double width {50};       // 毫米(mm)
+    double height {50};      // 毫米(mm)
+    double resolution {10};  // 线/毫米(lines/mm)
+    ImageToGCode::ScanMode scanMode {ImageToGCode::ScanMode::Bidirection};
+    ImageToGCode::LaserMode laserMode {ImageToGCode::LaserMode::Engraving};
+};
 
-    ImageToGCode ins;
-    // 50x50 mm 1.0 line/mm
-    ins.setInputImage(mat).setOutputTragetSize(50, 50, 10).builder().exportGCode(R"(\ImageToGCode\output\tigger.nc)");
+static std::optional<ImageToGCode::ScanMode> parseScanMode(std::string_view name) {
+    using Mode = ImageToGCode::ScanMode;
+    std::pair<std::string_view, Mode> const modes[] {
+        {"Unidirection", Mode::Unidirection},
+        {"Bidirection", Mode::Bidirection},
+        {"Diagonal", Mode::Diagonal},
+        {"Spiral", Mode::Spiral},
+        {"Block", Mode::Block},
+        {"BidirectionStd", Mode::BidirectionStd},
+        {"DiagonalUnidirection", Mode::DiagonalUnidirection},
+        {"Hatch", Mode::Hatch},
+        {"Contour", Mode::Contour},
+    };
+    for(auto const &[n, mode]: modes) {
+        if(n == name) {
+            return mode;
+        }
+    }
+    return std::nullopt;
+}
+
+// 名称不区分大小写(Names are case-insensitive)
+static std::optional<Dither::Method> parseDither(std::string_view name) {
+    using Method = Dither::Method;
+    std::pair<std::string_view, Method> const methods[] {
+        {"None", Method::None},
+        {"FloydSteinberg", Method::FloydSteinberg},
+        {"Jarvis", Method::Jarvis},
+        {"Stucki", Method::Stucki},
+        {"Atkinson", Method::Atkinson},
+        {"Bayer", Method::Bayer},
+    };
+    auto const lower = [](unsigned char c) { return std::tolower(c); };
+    for(auto const &[n, method]: methods) {
+        if(std::ranges::equal(n, name, {}, lower, lower)) {
+            return method;
+        }
+    }
+    return std::nullopt;
+}
+
+// 整个字符串都是数字时才有效(Valid only when the whole string is a number)
+template<class T>
+static std::optional<T> parseNumber(std::string_view text) {
+    T value {};
+    auto const [p, e] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if(e != std::errc {} || p != text.data() + text.size()) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+// 解析一个任务参数 key=value，成功返回 true。相对的输出路径以 base 为基准（清单所在目录）
+// Parse one job parameter key=value, true on success. A relative output path is taken relative to base (the directory of the manifest)
+static bool parseOption(Job &job, std::string_view key, std::string_view value, const fs::path &base = {}) {
+    if(key == "size") {
+        auto const x = value.find('x');
+        if(x == std::string_view::npos) {
+            return false;
+        }
+        auto const [p1, e1] = std::from_chars(value.data(), value.data() + x, job.width);
+        auto const [p2, e2] = std::from_chars(value.data() + x + 1, value.data() + value.size(), job.height);
+        return e1 == std::errc {} && e2 == std::errc {} && job.width > 0 && job.height > 0;
+    }
+    if(key == "resolution") {
+        auto const [p, e] = std::from_chars(value.data(), value.data() + value.size(), job.resolution);
+        return e == std::errc {} && job.resolution > 0;
+    }
+    if(key == "scan") {
+        auto const mode = parseScanMode(value);
+        job.scanMode    = mode.value_or(job.scanMode);
+        return mode.has_value();
+    }
+    if(key == "laser") {
+        if(value == "M3" || value == "M4") {
+            job.laserMode = value == "M3" ? ImageToGCode::LaserMode::Cutting : ImageToGCode::LaserMode::Engraving;
+            return true;
+        }
+        return false;
+    }
+    if(key == "output") {
+        job.output = base / value;
+        return true;
+    }
+    return false;
+}
+
+static bool isImage(const fs::path &path) {
+    auto extension = path.extension().string();
+    std::ranges::transform(extension, extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    for(auto const *e: {".png", ".jpg", ".jpeg", ".bmp", ".pgm", ".tif", ".tiff", ".webp"}) {
+        if(extension == e) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 按输入类型展开任务列表，defaults 为命令行给出的参数
+// Expand the input into the job list, defaults holds the command line parameters
+static bool collectJobs(const fs::path &input, const Job &defaults, std::vector<Job> &jobs) {
+    std::error_code ec;
+    if(fs::is_directory(input, ec)) {
+        for(auto const &entry: fs::directory_iterator(input, ec)) {
+            if(entry.is_regular_file() && isImage(entry.path())) {
+                auto &job = jobs.emplace_back(defaults);
+                job.input = entry.path();
+            }
+        }
+        // 目录遍历顺序与平台有关，排序后输出顺序稳定(Directory order depends on the platform, sort for a stable order)
+        std::ranges::sort(jobs, {}, &Job::input);
+        return !ec;
+    }
+    if(isImage(input)) {
+        auto &job = jobs.emplace_back(defaults);
+        job.input = input;
+        return true;
+    }
+
+    std::ifstream manifest(input);
+    if(!manifest.is_open()) {
+        return false;
+    }
+    std::size_t number = 0;
+    for(std::string line; std::getline(manifest, line);) {
+        ++number;
+        std::istringstream words(line);
+        std::string word;
+        if(!(words >> word) || word.starts_with('#')) {
+            continue;
+        }
+        Job job   = defaults;
+        job.input = input.parent_path() / word;
+        while(words >> word) {
+            auto const eq = word.find('=');
+            if(eq == std::string::npos && job.output.empty()) {
+                job.output = input.parent_path() / word;
+            } else if(eq == std::string::npos || !parseOption(job, std::string_view(word).substr(0, eq), std::string_view(word).substr(eq + 1), input.parent_path())) {
+                std::println("{}:{}: invalid parameter {}", input.string(), number, word);
+                return false;
+            }
+        }
+        jobs.push_back(std::move(job));
+    }
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    Job defaults;
+    fs::path input;
+    fs::path outputDirectory;
+    fs::path cacheDirectory;
+    std::uintmax_t cacheSize = 1024;  // MB
+    int threads              = 0;
+    bool flip                = true;
+    bool binary              = false;
+    auto dither              = Dither::Method::FloydSteinberg;
+    auto const usage = [&] {
+        std::println("usage: {} <image|directory|manifest> [-o dir] [--size WxH] [--resolution N] [--scan mode] [--laser M3|M4] [--threads N] [--no-flip] [--dither method|none] [--cache dir] [--cache-size MB] [--binary]", argv[0]);
+        return 1;
+    };
+    for(int i = 1; i < argc; ++i) {
+        std::string_view const arg = argv[i];
+        auto const hasValue        = i + 1 < argc;
+        if((arg == "-o" || arg == "--output") && hasValue) {
+            outputDirectory = argv[++i];
+        } else if(arg == "--threads" && hasValue) {
+            // 0 表示使用全部硬件线程(0 uses every hardware thread)
+            auto const value = parseNumber<int>(argv[++i]);
+            if(!value || *value < 0) {
+                return usage();
+            }
+            threads = *value;
+        } else if(arg == "--cache" && hasValue) {
+            cacheDirectory = argv[++i];
+        } else if(arg == "--cache-size" && hasValue) {
+            auto const value = parseNumber<std::uintmax_t>(argv[++i]);
+            if(!value) {
+                return usage();
+            }
+            cacheSize = *value;
+        } else if(arg == "--binary") {
+            binary = true;
+        } else if(arg == "--flip" || arg == "--no-flip") {
+            flip = arg == "--flip";
+        } else if(arg == "--dither" && hasValue) {
+            auto const method = parseDither(argv[++i]);
+            if(!method) {
+                return usage();
+            }
+            dither = *method;
+        } else if(arg.starts_with("--") && hasValue && arg != "--output") {
+            if(!parseOption(defaults, arg.substr(2), argv[++i])) {
+                return usage();
+            }
+        } else if(!arg.starts_with('-') && input.empty()) {
+            input = arg;
+        } else {
+            return usage();
+        }
+    }
+    if(input.empty()) {
+        return usage();
+    }
+
+    std::vector<Job> jobs;
+    if(!collectJobs(input, defaults, jobs)) {
+        std::println("can not read {}", input.string());
+        return 1;
+    }
+    for(auto &job: jobs) {
+        if(job.output.empty()) {
+            job.output = (outputDirectory.empty() ? job.input.parent_path() : outputDirectory) / job.input.filename().replace_extension(".nc");
+        }
+    }
+    if(!outputDirectory.empty()) {
+        fs::create_directories(outputDirectory);
+    }
+
+    // 每个线程一个生成器，跨任务复用其缓冲区；任务之间并行，单个任务内部不再开线程
+    // One generator per thread whose buffers are reused across jobs; parallelism is across jobs, a single job runs on one thread
+    WorkStealingPool pool(threads > 0 ? threads : static_cast<int>(std::max(1u, std::thread::hardware_concurrency())));
+    std::vector<ImageToGCode> generators(static_cast<std::size_t>(pool.size()));
+    std::optional<GCodeCache> cache;
+    if(!cacheDirectory.empty()) {
+        cache.emplace(cacheDirectory, cacheSize * 1024 * 1024);
+        for(auto &generator: generators) {
+            generator.setCache(&*cache);
+        }
+    }
+    std::atomic<std::size_t> converted {0};
+    std::atomic<std::size_t> failed {0};
+    std::atomic<std::uintmax_t> bytes {0};
+    std::atomic<std::uintmax_t> binaryBytes {0};
+
+    auto const begin = std::chrono::steady_clock::now();
+    pool.run(jobs.size(), [&](int worker, std::size_t index) {
+        auto const &job = jobs[index];
+        auto &generator = generators[static_cast<std::size_t>(worker)];
+        generator.setInputFile(job.input.string());
+        if(!generator.hasInput()) {
+            ++failed;
+            return;
+        }
+        generator.setOutputTragetSize(job.width, job.height, job.resolution)
+            .setThreadCount(1)
+            .setScanMode(job.scanMode)
+            .setLaserMode(job.laserMode)
+            .setFlipVertical(flip)
+            .setDither(dither)
+            .builder();
+        // 推迟解码的文件在生成时才知道能否读取(A file with deferred decoding is only known to be readable after generation)
+        if(!generator.hasInput() || !generator.exportGCode(job.output.string())) {
+            ++failed;
+            return;
+        }
+        std::error_code ec;
+        bytes += fs::file_size(job.output, ec);
+        if(binary) {
+            // 二进制工具路径与文本放在一起，扩展名为 .tpb(The binary toolpath goes next to the text with the .tpb extension)
+            auto const path = fs::path(job.output).replace_extension(".tpb");
+            if(!generator.exportBinary(path.string())) {
+                ++failed;
+                return;
+            }
+            binaryBytes += fs::file_size(path, ec);
+        }
+        ++converted;
+    });
+    auto const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    auto const megabytes = static_cast<double>(bytes.load()) / (1024.0 * 1024.0);
+    std::println("{} images converted, {} failed, {} threads, {:.3f} s", converted.load(), failed.load(), pool.size(), seconds);
+    std::println("{:.2f} images/s, {:.2f} MB G-code, {:.2f} MB/s", converted.load() / std::max(seconds, 1e-9), megabytes, megabytes / std::max(seconds, 1e-9));
+    if(binary) {
+        std::println("{:.2f} MB binary toolpath, {:.1f}x smaller than G-code", static_cast<double>(binaryBytes.load()) / (1024.0 * 1024.0), static_cast<double>(bytes.load()) / std::max<double>(1.0, static_cast<double>(binaryBytes.load())));
+    }
+    if(cache) {
+        auto const stats = cache->getStatistics();
+        std::println("cache {} hits, {} misses, {} stored, {} evicted, {:.2f} MB", stats.hits, stats.misses, stats.stores, stats.evictions, static_cast<double>(stats.bytes) / (1024.0 * 1024.0));
+    }
+    return failed.load() == 0 ? 0 : 1;
 }